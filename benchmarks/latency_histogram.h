@@ -0,0 +1,63 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ * Log-linear histogram of latencies in nanoseconds, for profiling one operation at a time.
+ *
+ * Values below 2 * kSubBuckets get a bucket each, above that every power of two is split into
+ * kSubBuckets equal buckets, so a bucket is never wider than 1/32 of the values in it. All the
+ * buckets are in the object, Record() neither allocates nor touches anything but one counter,
+ * which keeps the profiler out of the latencies it records.
+ *
+ * Percentile() returns the upper bound of the bucket the percentile falls in, never more than
+ * the largest value recorded.
+ */
+class LatencyHistogram {
+    static constexpr std::size_t kSubBucketBits = 5;
+    static constexpr std::size_t kSubBuckets = std::size_t(1) << kSubBucketBits;
+    static constexpr std::size_t kBuckets = (65 - kSubBucketBits) * kSubBuckets;
+
+public:
+    LatencyHistogram();
+
+    void Record(const std::uint64_t nanoseconds);
+    void Clear();
+    std::uint64_t Count() const;
+    std::uint64_t Min() const;
+    std::uint64_t Max() const;
+    double Mean() const;
+    std::uint64_t Percentile(const double percentile) const;
+    // (upper bound, count) of every bucket that is not empty, in increasing order
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> Buckets() const;
+
+private:
+    static std::size_t BucketIndex(const std::uint64_t value);
+    static std::uint64_t UpperBound(const std::size_t index);
+
+private:
+    std::array<std::uint64_t, kBuckets> m_counts;
+    std::uint64_t m_count;
+    std::uint64_t m_min;
+    std::uint64_t m_max;
+    long double m_sum;
+};
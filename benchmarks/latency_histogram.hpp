@@ -0,0 +1,115 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+inline LatencyHistogram::LatencyHistogram()
+    : m_counts()
+    , m_count(0)
+    , m_min(std::numeric_limits<std::uint64_t>::max())
+    , m_max(0)
+    , m_sum(0)
+{
+}
+
+inline void LatencyHistogram::Record(const std::uint64_t nanoseconds)
+{
+    m_counts[BucketIndex(nanoseconds)]++;
+    m_count++;
+    m_min = std::min(m_min, nanoseconds);
+    m_max = std::max(m_max, nanoseconds);
+    m_sum += nanoseconds;
+}
+
+inline void LatencyHistogram::Clear() { *this = LatencyHistogram(); }
+
+inline std::uint64_t LatencyHistogram::Count() const { return m_count; }
+
+inline std::uint64_t LatencyHistogram::Min() const { return (m_count == 0) ? 0 : m_min; }
+
+inline std::uint64_t LatencyHistogram::Max() const { return m_max; }
+
+inline double LatencyHistogram::Mean() const
+{
+    return (m_count == 0) ? 0.0 : static_cast<double>(m_sum / m_count);
+}
+
+inline std::uint64_t LatencyHistogram::Percentile(const double percentile) const
+{
+    if (m_count == 0)
+        return 0;
+
+    // the rank of the value below which percentile % of the values are, counted from 1; 99.9 is
+    // not exact in binary and 99.9 % of 1000 comes out a hair above 999, the slack keeps it there
+    const double clamped = std::clamp(percentile, 0.0, 100.0);
+    const double exact = clamped / 100.0 * static_cast<double>(m_count);
+    const auto rank
+        = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(exact * (1.0 - 1e-12))));
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; i++) {
+        seen += m_counts[i];
+
+        if (seen >= rank)
+            return std::min(UpperBound(i), m_max);
+    }
+
+    return m_max;
+}
+
+inline std::vector<std::pair<std::uint64_t, std::uint64_t>> LatencyHistogram::Buckets() const
+{
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> buckets;
+
+    for (std::size_t i = 0; i < kBuckets; i++) {
+        if (m_counts[i] != 0)
+            buckets.emplace_back(UpperBound(i), m_counts[i]);
+    }
+
+    return buckets;
+}
+
+// a value with its highest bit at b >= kSubBucketBits + 1 lands in group b - kSubBucketBits,
+// at the offset its next kSubBucketBits bits give
+inline std::size_t LatencyHistogram::BucketIndex(const std::uint64_t value)
+{
+    if (value < 2 * kSubBuckets)
+        return static_cast<std::size_t>(value);
+
+    const std::size_t highest_bit = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+    const std::size_t shift = highest_bit - kSubBucketBits;
+
+    return (shift + 1) * kSubBuckets + static_cast<std::size_t>((value >> shift) - kSubBuckets);
+}
+
+inline std::uint64_t LatencyHistogram::UpperBound(const std::size_t index)
+{
+    if (index < 2 * kSubBuckets)
+        return index;
+
+    // the last bucket ends at the largest 64-bit value, computing its end would overflow
+    if (index == kBuckets - 1)
+        return std::numeric_limits<std::uint64_t>::max();
+
+    const std::size_t shift = index / kSubBuckets - 1;
+    const std::uint64_t sub_bucket = index % kSubBuckets + kSubBuckets;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "map.hpp"
+#include "perf_counters.hpp"
+#include "workloads.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Native benchmarks of Map against std::map and std::unordered_map.
+ *
+ * Every benchmark is named operation/workload/types/library/n, e.g.
+ * "lookup/zipfian/string/Map/100000", and times n operations per iteration, so that real_time
+ * is comparable to the time (us) the Python measurements report. The time is measured by hand
+ * around the operations only, building the container to remove from and destroying the ones
+ * that were filled or copied is not counted.
+ *
+ * Sizes go up in powers of ten from 1000 to --max_size (1000000 unless given, up to 100000000).
+ * All the benchmark flags work, e.g.
+ *
+ *     map_bench --max_size=10000000 --benchmark_filter='^insert/uniform/int/'
+ *               --benchmark_out=results.json --benchmark_out_format=json
+ *
+ * and scripts/plot_benchmark_results.py plots the JSON. With --perf_counters every benchmark
+ * also reports the perf_event_open() counters this machine provides, per operation, as user
+ * counters of the timed region.
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::uint64_t kSeed = 2023;
+constexpr std::size_t kMinSize = 1000;
+constexpr std::size_t kMaxSize = 100000000;
+
+// only set with --perf_counters
+std::unique_ptr<PerfCounters> perf_counters;
+
+template <class Container> struct IsMap : std::false_type { };
+
+template <class K, class V, class A, class G, class S>
+struct IsMap<Map<K, V, A, G, S>> : std::true_type { };
+
+// the benchmarks are registered so that the ones sharing a stream run one after another, only
+// the last one is kept, at 100M keys a stream is 1.6 GB
+const KeyStream& GetKeyStream(const Workload workload, const std::size_t n)
+{
+    static Workload last_workload = Workload::SEQUENTIAL;
+    static std::size_t last_n = 0;
+    static KeyStream stream;
+
+    if (last_n != n || last_workload != workload) {
+        stream = KeyStream();
+        stream = MakeKeyStream(workload, n, kSeed);
+        last_workload = workload;
+        last_n = n;
+    }
+
+    return stream;
+}
+
+template <class Key> std::vector<Key> MakeKeys(const std::vector<std::uint64_t>& indices)
+{
+    std::vector<Key> keys;
+    keys.reserve(indices.size());
+
+    for (const std::uint64_t index : indices)
+        keys.push_back(MakeKey<Key>(index));
+
+    return keys;
+}
+
+template <class Container, class Key, class Value>
+void InsertInto(Container& container, const Key& key, const Value& value)
+{
+    if constexpr (IsMap<Container>::value)
+        container.Insert(key, value);
+    else
+        container.insert_or_assign(key, value);
+}
+
+template <class Container, class Key> bool Lookup(const Container& container, const Key& key)
+{
+    if constexpr (IsMap<Container>::value)
+        return container.Find(key) != nullptr;
+    else
+        return container.find(key) != container.end();
+}
+
+template <class Container, class Key> void RemoveFrom(Container& container, const Key& key)
+{
+    if constexpr (IsMap<Container>::value)
+        container.Remove(key);
+    else
+        container.erase(key);
+}
+
+template <class Container, class Key, class Value>
+Container Fill(const std::vector<Key>& keys, const Value& value)
+{
+    Container container;
+
+    for (const Key& key : keys)
+        InsertInto(container, key, value);
+
+    return container;
+}
+
+Clock::time_point StartPhase()
+{
+    if (perf_counters)
+        perf_counters->Start();
+
+    return Clock::now();
+}
+
+void StopPhase(benchmark::State& state, const Clock::time_point start)
+{
+    state.SetIterationTime(std::chrono::duration<double>(Clock::now() - start).count());
+
+    if (perf_counters)
+        perf_counters->Stop();
+}
+
+void Report(benchmark::State& state, const std::size_t n)
+{
+    const std::size_t operations = static_cast<std::size_t>(state.iterations()) * n;
+    state.SetItemsProcessed(static_cast<std::int64_t>(operations));
+
+    if (!perf_counters)
+        return;
+
+    for (const auto& [name, value] : perf_counters->PerOperation(operations))
+        state.counters[name] = value;
+
+    perf_counters->Clear();
+}
+
+template <class Container, class Key, class Value>
+void BenchmarkInsert(benchmark::State& state, const Workload workload)
+{
+    const std::size_t n = static_cast<std::size_t>(state.range(0));
+    const std::vector<Key> keys = MakeKeys<Key>(GetKeyStream(workload, n).order);
+    const Value value = MakeValue<Value>(1);
+
+    for (auto _ : state) {
+        Container container;
+
+        const auto start = StartPhase();
+        for (const Key& key : keys)
+            InsertInto(container, key, value);
+        StopPhase(state, start);
+    }
+
+    Report(state, n);
+}
+
+template <class Container, class Key, class Value>
+void BenchmarkLookup(benchmark::State& state, const Workload workload)
+{
+    const std::size_t n = static_cast<std::size_t>(state.range(0));
+    const KeyStream& stream = GetKeyStream(workload, n);
+    const Container container = Fill<Container>(MakeKeys<Key>(stream.order), MakeValue<Value>(1));
+    const std::vector<Key> queries = MakeKeys<Key>(stream.queries);
+
+    for (auto _ : state) {
+        std::size_t hits = 0;
+
+        const auto start = StartPhase();
+        for (const Key& key : queries)
+            hits += Lookup(container, key);
+        StopPhase(state, start);
+
+        benchmark::DoNotOptimize(hits);
+    }
+
+    Report(state, n);
+}
+
+template <class Container, class Key, class Value>
+void BenchmarkRemove(benchmark::State& state, const Workload workload)
+{
+    const std::size_t n = static_cast<std::size_t>(state.range(0));
+    const std::vector<Key> keys = MakeKeys<Key>(GetKeyStream(workload, n).order);
+    const Container filled = Fill<Container>(keys, MakeValue<Value>(1));
+
+    for (auto _ : state) {
+        Container container(filled);
+
+        const auto start = StartPhase();
+        for (const Key& key : keys)
+            RemoveFrom(container, key);
+        StopPhase(state, start);
+    }
+
+    Report(state, n);
+}
+
+template <class Container, class Key, class Value>
+void BenchmarkIterate(benchmark::State& state, const Workload workload)
+{
+    const std::size_t n = static_cast<std::size_t>(state.range(0));
+    const Container container
+        = Fill<Container>(MakeKeys<Key>(GetKeyStream(workload, n).order), MakeValue<Value>(1));
+
+    for (auto _ : state) {
+        const auto start = StartPhase();
+        for (const auto& entry : container)
+            benchmark::DoNotOptimize(entry);
+        StopPhase(state, start);
+    }
+
+    Report(state, n);
+}
+
+template <class Container, class Key, class Value>
+void BenchmarkCopy(benchmark::State& state, const Workload workload)
+{
+    const std::size_t n = static_cast<std::size_t>(state.range(0));
+    const Container container
+        = Fill<Container>(MakeKeys<Key>(GetKeyStream(workload, n).order), MakeValue<Value>(1));
+
+    for (auto _ : state) {
+        const auto start = StartPhase();
+        Container copy(container);
+        StopPhase(state, start);
+
+        benchmark::DoNotOptimize(copy);
+    }
+
+    Report(state, n);
+}
+
+template <class Container, class Key, class Value>
+void RegisterContainer(const std::string& types, const char* library, const Workload workload,
+                       const std::size_t n)
+{
+    using Function = void (*)(benchmark::State&, const Workload);
+
+    static const std::pair<const char*, Function> operations[]
+        = { { "insert", &BenchmarkInsert<Container, Key, Value> },
+            { "lookup", &BenchmarkLookup<Container, Key, Value> },
+            { "remove", &BenchmarkRemove<Container, Key, Value> },
+            { "iterate", &BenchmarkIterate<Container, Key, Value> },
+            { "copy", &BenchmarkCopy<Container, Key, Value> } };
+
+    for (const auto& [operation, function] : operations) {
+        const std::string name = std::string(operation) + "/" + WorkloadName(workload) + "/"
+            + types + "/" + library;
+
+        benchmark::RegisterBenchmark(name.c_str(), function, workload)
+            ->Arg(static_cast<std::int64_t>(n))
+            ->UseManualTime()
+            ->Unit(benchmark::kMicrosecond);
+    }
+}
+
+template <class Key, class Value>
+void RegisterTypes(const std::string& types, const Workload workload, const std::size_t n)
+{
+    RegisterContainer<Map<Key, Value>, Key, Value>(types, "Map", workload, n);
+    RegisterContainer<std::map<Key, Value>, Key, Value>(types, "std::map", workload, n);
+    RegisterContainer<std::unordered_map<Key, Value>, Key, Value>(types, "std::unordered_map",
+                                                                  workload, n);
+}
+
+// takes --max_size and --perf_counters out of the arguments, benchmark::Initialize() would reject
+// them
+std::size_t ParseFlags(int& argc, char** argv)
+{
+    const char* const max_size_flag = "--max_size=";
+    std::size_t max_size = 1000000;
+
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], max_size_flag, std::strlen(max_size_flag)) == 0)
+            max_size = std::strtoull(argv[i] + std::strlen(max_size_flag), nullptr, 10);
+        else if (std::strcmp(argv[i], "--perf_counters") == 0)
+            perf_counters = std::make_unique<PerfCounters>();
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    return std::min(max_size, kMaxSize);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t max_size = ParseFlags(argc, argv);
+
+    if (perf_counters && !perf_counters->AnyAvailable())
+        std::fprintf(stderr, "no perf_event_open() counters available, running without them\n");
+
+    for (const Workload workload :
+         { Workload::SEQUENTIAL, Workload::UNIFORM, Workload::ZIPFIAN, Workload::ADVERSARIAL }) {
+        for (std::size_t n = kMinSize; n <= max_size; n *= 10) {
+            RegisterTypes<int, int>("int", workload, n);
+            RegisterTypes<std::int64_t, std::int64_t>("int64", workload, n);
+            RegisterTypes<std::string, std::int64_t>("string", workload, n);
+            RegisterTypes<std::int64_t, Payload64>("payload64", workload, n);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
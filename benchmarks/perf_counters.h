@@ -0,0 +1,72 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+enum class PerfEvent {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    DTLB_MISSES,
+    PAGE_FAULTS,
+};
+
+/*
+ * Linux perf_event_open() counters of the calling thread, in user space only, for telling
+ * whether a measurement is bound by cache misses, branch mispredictions or TLB misses.
+ *
+ * Every event is opened on its own rather than as a group, so one the machine does not provide
+ * leaves the others working. Containers and virtual machines often have no hardware counters,
+ * or perf_event_paranoid forbids them; such events are left out without an error and
+ * Available() tells which ones are there. When the kernel has to multiplex counters, counts are
+ * scaled up by the share of time they were running.
+ *
+ * Start() and Stop() bracket a measured region, the counts of all regions add up until Clear().
+ */
+class PerfCounters {
+public:
+    static constexpr std::size_t kEvents = 7;
+
+    PerfCounters();
+    PerfCounters(const PerfCounters& other) = delete;
+    PerfCounters& operator=(const PerfCounters& other) = delete;
+    ~PerfCounters();
+
+    bool Available(const PerfEvent event) const;
+    bool AnyAvailable() const;
+    void Start();
+    void Stop();
+    void Clear();
+    double Get(const PerfEvent event) const;
+    // event name -> count / operations for the available events, plus instructions_per_cycle
+    std::map<std::string, double> PerOperation(const std::size_t operations) const;
+
+    static const char* Name(const PerfEvent event);
+
+private:
+    static int Open(const PerfEvent event);
+
+private:
+    std::array<int, kEvents> m_fds;
+    std::array<double, kEvents> m_counts;
+};
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "perf_counters.h"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+inline PerfCounters::PerfCounters()
+    : m_fds()
+    , m_counts()
+{
+    for (std::size_t i = 0; i < kEvents; i++)
+        m_fds[i] = Open(static_cast<PerfEvent>(i));
+}
+
+inline PerfCounters::~PerfCounters()
+{
+    for (const int fd : m_fds) {
+        if (fd >= 0)
+            ::close(fd);
+    }
+}
+
+inline bool PerfCounters::Available(const PerfEvent event) const
+{
+    return m_fds[static_cast<std::size_t>(event)] >= 0;
+}
+
+inline bool PerfCounters::AnyAvailable() const
+{
+    for (const int fd : m_fds) {
+        if (fd >= 0)
+            return true;
+    }
+
+    return false;
+}
+
+inline void PerfCounters::Start()
+{
+    for (const int fd : m_fds) {
+        if (fd >= 0) {
+            ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+inline void PerfCounters::Stop()
+{
+    for (const int fd : m_fds) {
+        if (fd >= 0)
+            ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (std::size_t i = 0; i < kEvents; i++) {
+        // value, time enabled, time running, as asked for by read_format
+        std::uint64_t values[3];
+
+        if (m_fds[i] < 0 || ::read(m_fds[i], values, sizeof(values)) != sizeof(values)
+            || values[2] == 0)
+            continue;
+
+        m_counts[i] += static_cast<double>(values[0]) * static_cast<double>(values[1])
+            / static_cast<double>(values[2]);
+    }
+}
+
+inline void PerfCounters::Clear() { m_counts.fill(0.0); }
+
+inline double PerfCounters::Get(const PerfEvent event) const
+{
+    return m_counts[static_cast<std::size_t>(event)];
+}
+
+inline std::map<std::string, double> PerfCounters::PerOperation(const std::size_t operations) const
+{
+    std::map<std::string, double> values;
+
+    if (operations == 0)
+        return values;
+
+    for (std::size_t i = 0; i < kEvents; i++) {
+        if (m_fds[i] >= 0)
+            values[Name(static_cast<PerfEvent>(i))] = m_counts[i] / operations;
+    }
+
+    const double cycles = Get(PerfEvent::CYCLES);
+    if (Available(PerfEvent::CYCLES) && Available(PerfEvent::INSTRUCTIONS) && cycles > 0)
+        values["instructions_per_cycle"] = Get(PerfEvent::INSTRUCTIONS) / cycles;
+
+    return values;
+}
+
+inline const char* PerfCounters::Name(const PerfEvent event)
+{
+    static const char* const names[kEvents] = { "cycles",        "instructions", "l1d_misses",
+                                                "llc_misses",    "branch_misses", "dtlb_misses",
+                                                "page_faults" };
+
+    return names[static_cast<std::size_t>(event)];
+}
+
+inline int PerfCounters::Open(const PerfEvent event)
+{
+    constexpr std::uint64_t kReadMiss
+        = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event) {
+    case PerfEvent::CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfEvent::INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfEvent::L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | kReadMiss;
+        break;
+    case PerfEvent::LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | kReadMiss;
+        break;
+    case PerfEvent::BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case PerfEvent::DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | kReadMiss;
+        break;
+    case PerfEvent::PAGE_FAULTS:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+        break;
+    }
+
+    // this thread on any CPU, -1 when the event cannot be counted here
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
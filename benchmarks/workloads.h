@@ -0,0 +1,72 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Key streams for the benchmarks. A stream holds n distinct keys in the order they are inserted
+ * (and removed), and n keys to look up. Keys are generated as 64-bit indices, the i-th key of a
+ * map of n is 2 * i and the odd indices in between are never inserted, so a lookup of one is a
+ * miss that still has to descend all the way. MakeKey() turns an index into a key of the type
+ * under test.
+ *
+ * SEQUENTIAL  inserts and looks up in ascending order.
+ * UNIFORM     inserts in random order and looks up uniformly drawn keys.
+ * ZIPFIAN     inserts in random order and looks up keys drawn from a Zipfian distribution
+ *             (theta 0.99, as in YCSB), with the popular ranks scattered over the key space.
+ * ADVERSARIAL inserts alternately from both ends towards the middle, the order that makes Map do
+ *             the most rotations and the longest insert paths, and looks up only misses.
+ */
+
+enum class Workload { SEQUENTIAL = 0, UNIFORM, ZIPFIAN, ADVERSARIAL };
+
+struct KeyStream {
+    std::vector<std::uint64_t> order;
+    std::vector<std::uint64_t> queries;
+};
+
+// a value the size of a cache line
+struct Payload64 {
+    std::array<std::uint64_t, 8> words;
+};
+
+// ranks in [0, n), rank 0 the most popular, after Gray et al., "Quickly generating billion-record
+// synthetic databases"; the constructor is O(n), drawing is O(1)
+class ZipfianGenerator {
+public:
+    explicit ZipfianGenerator(const std::uint64_t n, const double theta = 0.99);
+
+    std::uint64_t operator()(std::mt19937_64& rng);
+
+private:
+    std::uint64_t m_n;
+    double m_theta;
+    double m_alpha;
+    double m_zetan;
+    double m_eta;
+    std::uniform_real_distribution<double> m_uniform;
+};
+
+const char* WorkloadName(const Workload workload);
+KeyStream MakeKeyStream(const Workload workload, const std::size_t n, const std::uint64_t seed);
+template <class Key> Key MakeKey(const std::uint64_t index);
+template <class Value> Value MakeValue(const std::uint64_t index);
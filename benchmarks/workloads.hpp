@@ -0,0 +1,138 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "workloads.h"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+inline ZipfianGenerator::ZipfianGenerator(const std::uint64_t n, const double theta)
+    : m_n(n)
+    , m_theta(theta)
+    , m_alpha(1.0 / (1.0 - theta))
+    , m_zetan(0.0)
+    , m_eta(0.0)
+    , m_uniform(0.0, 1.0)
+{
+    for (std::uint64_t i = 1; i <= n; i++)
+        m_zetan += 1.0 / std::pow(static_cast<double>(i), theta);
+
+    const double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    m_eta = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / m_zetan);
+}
+
+inline std::uint64_t ZipfianGenerator::operator()(std::mt19937_64& rng)
+{
+    const double u = m_uniform(rng);
+    const double uz = u * m_zetan;
+
+    if (uz < 1.0)
+        return 0;
+
+    if (uz < 1.0 + std::pow(0.5, m_theta))
+        return std::min<std::uint64_t>(1, m_n - 1);
+
+    const auto rank = static_cast<std::uint64_t>(static_cast<double>(m_n)
+                                                 * std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+
+    return std::min(rank, m_n - 1);
+}
+
+inline const char* WorkloadName(const Workload workload)
+{
+    static const char* const names[] = { "sequential", "uniform", "zipfian", "adversarial" };
+
+    return names[static_cast<std::size_t>(workload)];
+}
+
+inline KeyStream MakeKeyStream(const Workload workload, const std::size_t n,
+                               const std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::uint64_t> uniform(0, n - 1);
+
+    KeyStream stream;
+    stream.order.resize(n);
+    stream.queries.resize(n);
+
+    switch (workload) {
+    case Workload::SEQUENTIAL:
+        for (std::size_t i = 0; i < n; i++)
+            stream.order[i] = 2 * i;
+
+        stream.queries = stream.order;
+        break;
+    case Workload::UNIFORM:
+        for (std::size_t i = 0; i < n; i++)
+            stream.order[i] = 2 * i;
+
+        std::shuffle(stream.order.begin(), stream.order.end(), rng);
+
+        for (auto& query : stream.queries)
+            query = 2 * uniform(rng);
+        break;
+    case Workload::ZIPFIAN: {
+        for (std::size_t i = 0; i < n; i++)
+            stream.order[i] = 2 * i;
+
+        std::shuffle(stream.order.begin(), stream.order.end(), rng);
+
+        // hashing the rank keeps the popular keys apart, like YCSB's scrambled zipfian
+        ZipfianGenerator zipfian(n);
+        for (auto& query : stream.queries) {
+            std::uint64_t rank = zipfian(rng) + 0x9e3779b97f4a7c15ULL;
+            rank = (rank ^ (rank >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            rank = (rank ^ (rank >> 27)) * 0x94d049bb133111ebULL;
+            query = 2 * ((rank ^ (rank >> 31)) % n);
+        }
+        break;
+    }
+    case Workload::ADVERSARIAL:
+        for (std::size_t i = 0; i < n; i++)
+            stream.order[i] = 2 * ((i % 2 == 0) ? i / 2 : n - 1 - i / 2);
+
+        for (auto& query : stream.queries)
+            query = 2 * uniform(rng) + 1;
+        break;
+    }
+
+    return stream;
+}
+
+// strings share a long prefix and are too long for the small string buffer, like real ids
+template <class Key> Key MakeKey(const std::uint64_t index)
+{
+    if constexpr (std::is_same_v<Key, std::string>) {
+        const std::string digits = std::to_string(index);
+
+        return "user:" + std::string(19 - digits.size(), '0') + digits;
+    } else {
+        return static_cast<Key>(index);
+    }
+}
+
+template <class Value> Value MakeValue(const std::uint64_t index)
+{
+    if constexpr (std::is_same_v<Value, Payload64>) {
+        Payload64 payload;
+        payload.words.fill(index);
+
+        return payload;
+    } else {
+        return static_cast<Value>(index);
+    }
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+/*
+ * Augmentations let Map keep a summary of every subtree in the subtree's root node.
+ *
+ * An augmentation has a Summary type, whose default value is the summary of an empty subtree, and
+ * a static Update(summary, left, entry, right) that computes the summary of a node from the ones
+ * of its children and its own entry. Map calls it for every node whose subtree changes: on the
+ * path of an insert or a remove, and for the two nodes of every rotation, so the summaries are
+ * kept up to date in O(log n) per update.
+ */
+
+// no summary at all, the nodes stay as small as without augmentation
+struct NoAugmentation {
+    struct Summary {
+    };
+
+    template <class Entry>
+    static void Update(Summary& /* summary */, const Summary& /* left */, const Entry& /* entry */,
+                       const Summary& /* right */)
+    {
+    }
+};
+
+// subtree sizes, for Rank(), Select() and CountRange()
+struct OrderStatistics {
+    struct Summary {
+        std::size_t size = 0;
+    };
+
+    template <class Entry>
+    static void Update(Summary& summary, const Summary& left, const Entry& /* entry */,
+                       const Summary& right)
+    {
+        summary.size = left.size + 1 + right.size;
+    }
+};
+
+/*
+ * The values of every subtree folded with an associative Monoid, for Aggregate(lo, hi).
+ *
+ * A Monoid has a value_type that Value converts to, a static Identity() and a static
+ * Combine(lhs, rhs), which is called with lhs holding the smaller keys so it need not be
+ * commutative. Values changed through Insert() or InsertOrAssign() update the aggregates on their
+ * path, values changed through Find() or an iterator do not.
+ */
+template <class M> struct Aggregation {
+    using Monoid = M;
+    using value_type = typename Monoid::value_type;
+
+    struct Summary {
+        value_type aggregate = Monoid::Identity();
+    };
+
+    template <class Entry>
+    static void Update(Summary& summary, const Summary& left, const Entry& entry,
+                       const Summary& right)
+    {
+        summary.aggregate = Monoid::Combine(
+            Monoid::Combine(left.aggregate, static_cast<value_type>(entry.second)),
+            right.aggregate);
+    }
+};
+
+template <class T> struct SumMonoid {
+    using value_type = T;
+
+    static T Identity() { return T(); }
+    static T Combine(const T& lhs, const T& rhs) { return lhs + rhs; }
+};
+
+template <class T> struct MinMonoid {
+    using value_type = T;
+
+    static T Identity() { return std::numeric_limits<T>::max(); }
+    static T Combine(const T& lhs, const T& rhs) { return std::min(lhs, rhs); }
+};
+
+template <class T> struct MaxMonoid {
+    using value_type = T;
+
+    static T Identity() { return std::numeric_limits<T>::lowest(); }
+    static T Combine(const T& lhs, const T& rhs) { return std::max(lhs, rhs); }
+};
+
+// the largest end of the [start, end) interval keys in every subtree, for IntervalMap. An empty
+// subtree has numeric_limits<Point>::lowest(), below every end.
+template <class Point> struct MaxEndpoint {
+    struct Summary {
+        Point max_end = std::numeric_limits<Point>::lowest();
+    };
+
+    template <class Entry>
+    static void Update(Summary& summary, const Summary& left, const Entry& entry,
+                       const Summary& right)
+    {
+        summary.max_end = std::max({ left.max_end, entry.first.second, right.max_end });
+    }
+};
+
+// whether the summaries of Augmentation count the entries in their subtree
+template <class Augmentation, class = void> struct CountsSubtreeSize : std::false_type {
+};
+
+template <class Augmentation>
+struct CountsSubtreeSize<Augmentation, std::void_t<decltype(Augmentation::Summary::size)>>
+    : std::true_type {
+};
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "node_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/*
+ * B+tree with the same Insert/At/Remove/Size interface as Map.
+ *
+ * Every node is NodeBytes wide and aligned to a cache line, inner nodes only hold separator keys
+ * and child pointers so a lookup touches one node per level instead of one per key comparison.
+ * Entries live in the leaves, which are linked left to right for range scans.
+ */
+template <class Key, class Value, std::size_t NodeBytes = 256,
+          class Allocator = std::allocator<std::pair<const Key, Value>>>
+class BTreeMap {
+
+    static constexpr std::size_t kCacheLine = 64;
+
+    static constexpr std::size_t Fit(const std::size_t header, const std::size_t slot)
+    {
+        return (NodeBytes > header + 4 * slot) ? (NodeBytes - header) / slot : 4;
+    }
+
+    static constexpr std::size_t kLeafCapacity
+        = Fit(sizeof(std::uint32_t) + sizeof(void*), sizeof(Key) + sizeof(Value));
+    static constexpr std::size_t kInnerCapacity
+        = Fit(sizeof(std::uint32_t) + sizeof(void*), sizeof(Key) + sizeof(void*));
+
+    struct alignas(kCacheLine) Leaf {
+        std::uint32_t count;
+        Leaf* next;
+        Key keys[kLeafCapacity];
+        Value values[kLeafCapacity];
+    };
+
+    // children[i] holds the keys in [keys[i - 1], keys[i]), they are leaves on the lowest level
+    struct alignas(kCacheLine) Inner {
+        std::uint32_t count;
+        Key keys[kInnerCapacity];
+        void* children[kInnerCapacity + 1];
+    };
+
+    using LeafAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Leaf>;
+    using InnerAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Inner>;
+
+    struct Split {
+        Key key;
+        void* node = nullptr;
+    };
+
+public:
+    explicit BTreeMap(const Allocator& allocator = Allocator());
+    BTreeMap(const BTreeMap& other);
+    BTreeMap& operator=(const BTreeMap& other);
+    BTreeMap(BTreeMap&& other) noexcept;
+    BTreeMap& operator=(BTreeMap&& other) noexcept;
+    ~BTreeMap();
+
+    Value At(const Key& key) const;
+    Value* Find(const Key& key);
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    void Insert(const Key& key, const Value& value);
+    void Remove(const Key& key);
+    std::size_t Size() const;
+    std::size_t Height() const;
+    void Clear();
+    template <class Function>
+    void ForEachInRange(const Key& lo, const Key& hi, Function fn) const;
+    std::size_t MemoryUsage() const;
+
+private:
+    const Leaf* FindLeaf(const Key& key) const;
+    std::size_t LowerBoundIndex(const Key* keys, const std::size_t count, const Key& key) const;
+    std::size_t UpperBoundIndex(const Key* keys, const std::size_t count, const Key& key) const;
+    bool InsertInto(void* node, const std::size_t level, const Key& key, const Value& value,
+                    Split& split);
+    bool InsertIntoLeaf(Leaf* leaf, const Key& key, const Value& value, Split& split);
+    bool InsertIntoInner(Inner* inner, const std::size_t index, Split& child_split, Split& split);
+    static void PlaceInLeaf(Leaf* leaf, const std::size_t index, const Key& key,
+                            const Value& value);
+    static void PlaceInInner(Inner* inner, const std::size_t index, Split& split);
+    bool RemoveFrom(void* node, const std::size_t level, const Key& key);
+    void RebalanceLeaf(Inner* parent, const std::size_t index);
+    void RebalanceInner(Inner* parent, const std::size_t index);
+    void MergeLeaves(Inner* parent, const std::size_t index);
+    void MergeInners(Inner* parent, const std::size_t index);
+    static void DropChild(Inner* parent, const std::size_t index);
+    void CopyTree(const BTreeMap& other);
+    void* CopyNode(const void* node, const std::size_t level, Leaf*& previous);
+    void DeleteTree(void* node, const std::size_t level);
+
+private:
+    std::less<Key> m_comparator;
+    NodePool<Leaf, LeafAllocator> m_leaves;
+    NodePool<Inner, InnerAllocator> m_inners;
+    void* m_root;
+    std::size_t m_height;
+    std::size_t m_size;
+};
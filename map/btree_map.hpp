@@ -0,0 +1,656 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "btree_map.h"
+#include "node_pool.hpp"
+#include "node_search.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>::BTreeMap(const Allocator& allocator)
+    : m_comparator()
+    , m_leaves(LeafAllocator(allocator))
+    , m_inners(InnerAllocator(allocator))
+    , m_root(nullptr)
+    , m_height(0)
+    , m_size(0)
+{
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>::BTreeMap(const BTreeMap& other)
+    : m_comparator()
+    , m_leaves(std::allocator_traits<LeafAllocator>::select_on_container_copy_construction(
+          other.m_leaves.GetAllocator()))
+    , m_inners(std::allocator_traits<InnerAllocator>::select_on_container_copy_construction(
+          other.m_inners.GetAllocator()))
+    , m_root(nullptr)
+    , m_height(0)
+    , m_size(0)
+{
+    CopyTree(other);
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>&
+BTreeMap<Key, Value, NodeBytes, Allocator>::operator=(const BTreeMap& other)
+{
+    using Traits = std::allocator_traits<LeafAllocator>;
+
+    if (this != &other) {
+        Clear();
+
+        // like the standard containers, the allocator of other comes along when it asks to
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (m_leaves.GetAllocator() != other.m_leaves.GetAllocator()) {
+                m_leaves = NodePool<Leaf, LeafAllocator>(other.m_leaves.GetAllocator());
+                m_inners = NodePool<Inner, InnerAllocator>(other.m_inners.GetAllocator());
+            }
+        }
+
+        CopyTree(other);
+    }
+
+    return *this;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>::BTreeMap(BTreeMap&& other) noexcept
+    : m_comparator(other.m_comparator)
+    , m_leaves(std::move(other.m_leaves))
+    , m_inners(std::move(other.m_inners))
+    , m_root(other.m_root)
+    , m_height(other.m_height)
+    , m_size(other.m_size)
+{
+    other.m_root = nullptr;
+    other.m_height = 0;
+    other.m_size = 0;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>&
+BTreeMap<Key, Value, NodeBytes, Allocator>::operator=(BTreeMap&& other) noexcept
+{
+    if (this != &other) {
+        Clear();
+
+        m_leaves = std::move(other.m_leaves);
+        m_inners = std::move(other.m_inners);
+        m_root = other.m_root;
+        m_height = other.m_height;
+        m_size = other.m_size;
+
+        other.m_root = nullptr;
+        other.m_height = 0;
+        other.m_size = 0;
+    }
+
+    return *this;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+BTreeMap<Key, Value, NodeBytes, Allocator>::~BTreeMap()
+{
+    Clear();
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+Value BTreeMap<Key, Value, NodeBytes, Allocator>::At(const Key& key) const
+{
+    const Value* value = Find(key);
+
+    if (value == nullptr) {
+        if constexpr (std::is_arithmetic_v<Key>)
+            throw std::out_of_range("invalid key: " + std::to_string(key));
+        else
+            throw std::out_of_range("invalid key");
+    }
+
+    return *value;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+Value* BTreeMap<Key, Value, NodeBytes, Allocator>::Find(const Key& key)
+{
+    return const_cast<Value*>(static_cast<const BTreeMap*>(this)->Find(key));
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+const Value* BTreeMap<Key, Value, NodeBytes, Allocator>::Find(const Key& key) const
+{
+    const Leaf* leaf = FindLeaf(key);
+
+    if (leaf == nullptr)
+        return nullptr;
+
+    const std::size_t index = LowerBoundIndex(leaf->keys, leaf->count, key);
+
+    if (index == leaf->count || m_comparator(key, leaf->keys[index]))
+        return nullptr;
+
+    return &leaf->values[index];
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+bool BTreeMap<Key, Value, NodeBytes, Allocator>::Contains(const Key& key) const
+{
+    return Find(key) != nullptr;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::Insert(const Key& key, const Value& value)
+{
+    if (m_root == nullptr) {
+        m_root = m_leaves.Create();
+        m_height = 0;
+    }
+
+    Split split;
+
+    if (InsertInto(m_root, m_height, key, value, split)) {
+        Inner* root = m_inners.Create();
+        root->count = 1;
+        root->keys[0] = std::move(split.key);
+        root->children[0] = m_root;
+        root->children[1] = split.node;
+        m_root = root;
+        m_height++;
+    }
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::Remove(const Key& key)
+{
+    if (m_root == nullptr || !RemoveFrom(m_root, m_height, key))
+        return;
+
+    m_size--;
+
+    if (m_height > 0) {
+        Inner* root = static_cast<Inner*>(m_root);
+
+        if (root->count == 0) {
+            m_root = root->children[0];
+            m_inners.Destroy(root);
+            m_height--;
+        }
+    } else if (static_cast<Leaf*>(m_root)->count == 0) {
+        m_leaves.Destroy(static_cast<Leaf*>(m_root));
+        m_root = nullptr;
+    }
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+std::size_t BTreeMap<Key, Value, NodeBytes, Allocator>::Size() const
+{
+    return m_size;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+std::size_t BTreeMap<Key, Value, NodeBytes, Allocator>::Height() const
+{
+    return (m_root == nullptr) ? 0 : m_height + 1;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::Clear()
+{
+    if (m_root != nullptr)
+        DeleteTree(m_root, m_height);
+
+    m_leaves.Release();
+    m_inners.Release();
+    m_root = nullptr;
+    m_height = 0;
+    m_size = 0;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+template <class Function>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::ForEachInRange(const Key& lo, const Key& hi,
+                                                                Function fn) const
+{
+    const Leaf* leaf = FindLeaf(lo);
+
+    if (leaf == nullptr)
+        return;
+
+    std::size_t index = LowerBoundIndex(leaf->keys, leaf->count, lo);
+
+    for (; leaf != nullptr; leaf = leaf->next, index = 0) {
+        for (; index < leaf->count; index++) {
+            if (!m_comparator(leaf->keys[index], hi))
+                return;
+
+            fn(leaf->keys[index], leaf->values[index]);
+        }
+    }
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+std::size_t BTreeMap<Key, Value, NodeBytes, Allocator>::MemoryUsage() const
+{
+    return sizeof(*this) + m_leaves.MemoryUsage() + m_inners.MemoryUsage();
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+const typename BTreeMap<Key, Value, NodeBytes, Allocator>::Leaf*
+BTreeMap<Key, Value, NodeBytes, Allocator>::FindLeaf(const Key& key) const
+{
+    const void* node = m_root;
+
+    if (node == nullptr)
+        return nullptr;
+
+    for (std::size_t level = m_height; level > 0; level--) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[UpperBoundIndex(inner->keys, inner->count, key)];
+    }
+
+    return static_cast<const Leaf*>(node);
+}
+
+// both searches halve the range without a data dependent branch, the compiler turns the step
+// into a conditional move so a node costs log2(count) comparisons and no mispredictions. Signed
+// integer keys count the smaller keys of the whole node with SIMD compares instead.
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+std::size_t BTreeMap<Key, Value, NodeBytes, Allocator>::LowerBoundIndex(const Key* keys,
+                                                                        const std::size_t count,
+                                                                        const Key& key) const
+{
+    if constexpr (NodeSearch<Key>::kVectorized)
+        return NodeSearch<Key>::CountLess(keys, count, key);
+
+    if (count == 0)
+        return 0;
+
+    const Key* base = keys;
+    std::size_t n = count;
+
+    while (n > 1) {
+        const std::size_t half = n / 2;
+        base = m_comparator(base[half], key) ? base + half : base;
+        n -= half;
+    }
+
+    return (base - keys) + m_comparator(*base, key);
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+std::size_t BTreeMap<Key, Value, NodeBytes, Allocator>::UpperBoundIndex(const Key* keys,
+                                                                        const std::size_t count,
+                                                                        const Key& key) const
+{
+    if constexpr (NodeSearch<Key>::kVectorized)
+        return NodeSearch<Key>::CountLessEqual(keys, count, key);
+
+    if (count == 0)
+        return 0;
+
+    const Key* base = keys;
+    std::size_t n = count;
+
+    while (n > 1) {
+        const std::size_t half = n / 2;
+        base = m_comparator(key, base[half]) ? base : base + half;
+        n -= half;
+    }
+
+    return (base - keys) + !m_comparator(key, *base);
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+bool BTreeMap<Key, Value, NodeBytes, Allocator>::InsertInto(void* node, const std::size_t level,
+                                                            const Key& key, const Value& value,
+                                                            Split& split)
+{
+    if (level == 0)
+        return InsertIntoLeaf(static_cast<Leaf*>(node), key, value, split);
+
+    Inner* inner = static_cast<Inner*>(node);
+    const std::size_t index = UpperBoundIndex(inner->keys, inner->count, key);
+    Split child_split;
+
+    if (!InsertInto(inner->children[index], level - 1, key, value, child_split))
+        return false;
+
+    return InsertIntoInner(inner, index, child_split, split);
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+bool BTreeMap<Key, Value, NodeBytes, Allocator>::InsertIntoLeaf(Leaf* leaf, const Key& key,
+                                                                const Value& value, Split& split)
+{
+    const std::size_t index = LowerBoundIndex(leaf->keys, leaf->count, key);
+
+    if (index < leaf->count && !m_comparator(key, leaf->keys[index])) {
+        leaf->values[index] = value;
+        return false;
+    }
+
+    m_size++;
+
+    if (leaf->count < kLeafCapacity) {
+        PlaceInLeaf(leaf, index, key, value);
+        return false;
+    }
+
+    // appending to the last leaf is what ascending input does, leave that leaf full instead of
+    // splitting it in half so sequential loads end up with packed leaves
+    const std::size_t mid
+        = (index == kLeafCapacity && leaf->next == nullptr) ? kLeafCapacity : kLeafCapacity / 2;
+    Leaf* right = m_leaves.Create();
+
+    std::move(leaf->keys + mid, leaf->keys + kLeafCapacity, right->keys);
+    std::move(leaf->values + mid, leaf->values + kLeafCapacity, right->values);
+    right->count = kLeafCapacity - mid;
+    leaf->count = mid;
+    right->next = leaf->next;
+    leaf->next = right;
+
+    if (index < mid)
+        PlaceInLeaf(leaf, index, key, value);
+    else
+        PlaceInLeaf(right, index - mid, key, value);
+
+    split.key = right->keys[0];
+    split.node = right;
+
+    return true;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+bool BTreeMap<Key, Value, NodeBytes, Allocator>::InsertIntoInner(Inner* inner,
+                                                                 const std::size_t index,
+                                                                 Split& child_split, Split& split)
+{
+    if (inner->count < kInnerCapacity) {
+        PlaceInInner(inner, index, child_split);
+        return false;
+    }
+
+    // keys[mid] moves up to the parent, everything after it goes to the new right node
+    const std::size_t mid = kInnerCapacity / 2;
+    Inner* right = m_inners.Create();
+
+    split.key = std::move(inner->keys[mid]);
+    std::move(inner->keys + mid + 1, inner->keys + kInnerCapacity, right->keys);
+    std::copy(inner->children + mid + 1, inner->children + kInnerCapacity + 1, right->children);
+    right->count = kInnerCapacity - mid - 1;
+    inner->count = mid;
+
+    if (index <= mid)
+        PlaceInInner(inner, index, child_split);
+    else
+        PlaceInInner(right, index - mid - 1, child_split);
+
+    split.node = right;
+
+    return true;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::PlaceInLeaf(Leaf* leaf, const std::size_t index,
+                                                             const Key& key, const Value& value)
+{
+    std::move_backward(leaf->keys + index, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::move_backward(leaf->values + index, leaf->values + leaf->count,
+                       leaf->values + leaf->count + 1);
+    leaf->keys[index] = key;
+    leaf->values[index] = value;
+    leaf->count++;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::PlaceInInner(Inner* inner, const std::size_t index,
+                                                              Split& split)
+{
+    std::move_backward(inner->keys + index, inner->keys + inner->count,
+                       inner->keys + inner->count + 1);
+    std::copy_backward(inner->children + index + 1, inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->keys[index] = std::move(split.key);
+    inner->children[index + 1] = split.node;
+    inner->count++;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+bool BTreeMap<Key, Value, NodeBytes, Allocator>::RemoveFrom(void* node, const std::size_t level,
+                                                            const Key& key)
+{
+    if (level == 0) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        const std::size_t index = LowerBoundIndex(leaf->keys, leaf->count, key);
+
+        if (index == leaf->count || m_comparator(key, leaf->keys[index]))
+            return false;
+
+        std::move(leaf->keys + index + 1, leaf->keys + leaf->count, leaf->keys + index);
+        std::move(leaf->values + index + 1, leaf->values + leaf->count, leaf->values + index);
+        leaf->count--;
+
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    const std::size_t index = UpperBoundIndex(inner->keys, inner->count, key);
+    void* child = inner->children[index];
+
+    if (!RemoveFrom(child, level - 1, key))
+        return false;
+
+    if (level == 1) {
+        if (static_cast<Leaf*>(child)->count < kLeafCapacity / 2)
+            RebalanceLeaf(inner, index);
+    } else if (static_cast<Inner*>(child)->count < kInnerCapacity / 2) {
+        RebalanceInner(inner, index);
+    }
+
+    return true;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::RebalanceLeaf(Inner* parent,
+                                                               const std::size_t index)
+{
+    Leaf* child = static_cast<Leaf*>(parent->children[index]);
+
+    if (index > 0) {
+        Leaf* left = static_cast<Leaf*>(parent->children[index - 1]);
+
+        if (left->count <= kLeafCapacity / 2) {
+            MergeLeaves(parent, index - 1);
+            return;
+        }
+
+        PlaceInLeaf(child, 0, left->keys[left->count - 1], left->values[left->count - 1]);
+        left->count--;
+        parent->keys[index - 1] = child->keys[0];
+
+        return;
+    }
+
+    Leaf* right = static_cast<Leaf*>(parent->children[index + 1]);
+
+    if (right->count <= kLeafCapacity / 2) {
+        MergeLeaves(parent, index);
+        return;
+    }
+
+    PlaceInLeaf(child, child->count, right->keys[0], right->values[0]);
+    std::move(right->keys + 1, right->keys + right->count, right->keys);
+    std::move(right->values + 1, right->values + right->count, right->values);
+    right->count--;
+    parent->keys[index] = right->keys[0];
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::RebalanceInner(Inner* parent,
+                                                                const std::size_t index)
+{
+    Inner* child = static_cast<Inner*>(parent->children[index]);
+
+    // borrowing rotates one separator through the parent, the child it guards moves along
+    if (index > 0) {
+        Inner* left = static_cast<Inner*>(parent->children[index - 1]);
+
+        if (left->count <= kInnerCapacity / 2) {
+            MergeInners(parent, index - 1);
+            return;
+        }
+
+        std::move_backward(child->keys, child->keys + child->count,
+                           child->keys + child->count + 1);
+        std::copy_backward(child->children, child->children + child->count + 1,
+                           child->children + child->count + 2);
+        child->keys[0] = std::move(parent->keys[index - 1]);
+        child->children[0] = left->children[left->count];
+        child->count++;
+        parent->keys[index - 1] = std::move(left->keys[left->count - 1]);
+        left->count--;
+
+        return;
+    }
+
+    Inner* right = static_cast<Inner*>(parent->children[index + 1]);
+
+    if (right->count <= kInnerCapacity / 2) {
+        MergeInners(parent, index);
+        return;
+    }
+
+    child->keys[child->count] = std::move(parent->keys[index]);
+    child->children[child->count + 1] = right->children[0];
+    child->count++;
+    parent->keys[index] = std::move(right->keys[0]);
+    std::move(right->keys + 1, right->keys + right->count, right->keys);
+    std::copy(right->children + 1, right->children + right->count + 1, right->children);
+    right->count--;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::MergeLeaves(Inner* parent,
+                                                             const std::size_t index)
+{
+    Leaf* left = static_cast<Leaf*>(parent->children[index]);
+    Leaf* right = static_cast<Leaf*>(parent->children[index + 1]);
+
+    std::move(right->keys, right->keys + right->count, left->keys + left->count);
+    std::move(right->values, right->values + right->count, left->values + left->count);
+    left->count += right->count;
+    left->next = right->next;
+
+    m_leaves.Destroy(right);
+    DropChild(parent, index);
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::MergeInners(Inner* parent,
+                                                             const std::size_t index)
+{
+    Inner* left = static_cast<Inner*>(parent->children[index]);
+    Inner* right = static_cast<Inner*>(parent->children[index + 1]);
+
+    left->keys[left->count] = std::move(parent->keys[index]);
+    std::move(right->keys, right->keys + right->count, left->keys + left->count + 1);
+    std::copy(right->children, right->children + right->count + 1,
+              left->children + left->count + 1);
+    left->count += right->count + 1;
+
+    m_inners.Destroy(right);
+    DropChild(parent, index);
+}
+
+// drops keys[index] and children[index + 1] once the two children around it were merged
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::DropChild(Inner* parent, const std::size_t index)
+{
+    std::move(parent->keys + index + 1, parent->keys + parent->count, parent->keys + index);
+    std::copy(parent->children + index + 2, parent->children + parent->count + 1,
+              parent->children + index + 1);
+    parent->count--;
+}
+
+// node for node, so the copy is exactly as full as other and takes no more memory
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::CopyTree(const BTreeMap& other)
+{
+    if (other.m_root == nullptr)
+        return;
+
+    Leaf* previous = nullptr;
+    m_root = CopyNode(other.m_root, other.m_height, previous);
+    m_height = other.m_height;
+    m_size = other.m_size;
+}
+
+// the leaves are copied left to right, each one is linked behind previous
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void* BTreeMap<Key, Value, NodeBytes, Allocator>::CopyNode(const void* node,
+                                                          const std::size_t level,
+                                                          Leaf*& previous)
+{
+    if (level == 0) {
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        Leaf* copy = m_leaves.Create();
+
+        copy->count = leaf->count;
+        std::copy(leaf->keys, leaf->keys + leaf->count, copy->keys);
+        std::copy(leaf->values, leaf->values + leaf->count, copy->values);
+
+        if (previous != nullptr)
+            previous->next = copy;
+        previous = copy;
+
+        return copy;
+    }
+
+    const Inner* inner = static_cast<const Inner*>(node);
+    Inner* copy = m_inners.Create();
+
+    copy->count = inner->count;
+    std::copy(inner->keys, inner->keys + inner->count, copy->keys);
+    for (std::size_t i = 0; i <= inner->count; i++)
+        copy->children[i] = CopyNode(inner->children[i], level - 1, previous);
+
+    return copy;
+}
+
+template <class Key, class Value, std::size_t NodeBytes, class Allocator>
+void BTreeMap<Key, Value, NodeBytes, Allocator>::DeleteTree(void* node, const std::size_t level)
+{
+    // the pools hand the slabs back without running destructors, nothing to do for plain data
+    if constexpr (std::is_trivially_destructible_v<Key> && std::is_trivially_destructible_v<Value>)
+        return;
+
+    if (level == 0) {
+        m_leaves.Destroy(static_cast<Leaf*>(node));
+        return;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+
+    for (std::size_t i = 0; i <= inner->count; i++)
+        DeleteTree(inner->children[i], level - 1);
+
+    m_inners.Destroy(inner);
+}
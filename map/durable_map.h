@@ -0,0 +1,99 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "map.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct DurabilityOptions {
+    // updates per fdatasync() of the log, the last sync_every - 1 may be lost in a crash
+    std::size_t sync_every = 1;
+    // updates logged before the map is checkpointed and the log emptied, 0 never checkpoints
+    std::size_t checkpoint_every = 1 << 20;
+};
+
+/*
+ * Map that survives crashes, kept in a directory as a snapshot and a write-ahead log.
+ *
+ * Insert() and Remove() append a fixed size record, with its own checksum, to the log before
+ * they change the map. Records are collected and written with one fdatasync() for every
+ * sync_every of them (group commit), Sync() forces the ones still pending out. Every
+ * checkpoint_every updates Checkpoint() saves the map with SaveBinary() and empties the log.
+ *
+ * Opening the directory loads the snapshot and replays the log on top of it with ApplyBatch(),
+ * kReplayBatch records at a time. Replay stops at the first record that is cut short or whose
+ * checksum does not match, the tail of a write the crash interrupted, and the log is truncated
+ * there. Like Map, a DurableMap is for one thread at a time.
+ */
+template <class Key, class Value> class DurableMap {
+
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "the log holds raw copies of trivially copyable keys and values");
+
+    enum class Operation : std::uint8_t { INSERT = 1, REMOVE };
+
+    struct LogHeader {
+        // "MAPWAL01" read as a little-endian word
+        static constexpr std::uint64_t kMagic = 0x31304c415750414dULL;
+
+        std::uint64_t magic;
+        std::uint32_t key_size;
+        std::uint32_t value_size;
+    };
+
+    // operation, key, value (zeroed for a remove), then the checksum of the three
+    static constexpr std::size_t kPayloadSize = 1 + sizeof(Key) + sizeof(Value);
+    static constexpr std::size_t kRecordSize = kPayloadSize + sizeof(std::uint64_t);
+    static constexpr std::size_t kReplayBatch = 1 << 16;
+
+public:
+    explicit DurableMap(const std::string& directory,
+                        const DurabilityOptions& options = DurabilityOptions());
+    DurableMap(const DurableMap& other) = delete;
+    DurableMap& operator=(const DurableMap& other) = delete;
+    ~DurableMap();
+
+    Value At(const Key& key) const;
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    void Insert(const Key& key, const Value& value);
+    void Remove(const Key& key);
+    std::size_t Size() const;
+    void Sync();
+    void Checkpoint();
+
+private:
+    void OpenLog();
+    void Replay();
+    void Log(const Operation operation, const Key& key, const Value* value);
+    void Write(const unsigned char* data, std::size_t size);
+    void SyncDirectory() const;
+
+private:
+    std::string m_directory;
+    std::string m_snapshot;
+    std::string m_log_path;
+    DurabilityOptions m_options;
+    Map<Key, Value> m_map;
+    int m_log;
+    std::vector<unsigned char> m_pending;
+    std::size_t m_unsynced;
+    std::size_t m_logged;
+};
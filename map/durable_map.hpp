@@ -0,0 +1,284 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "durable_map.h"
+#include "map.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+template <class Key, class Value>
+DurableMap<Key, Value>::DurableMap(const std::string& directory, const DurabilityOptions& options)
+    : m_directory(directory)
+    , m_snapshot(directory + "/snapshot.bin")
+    , m_log_path(directory + "/wal.log")
+    , m_options(options)
+    , m_map()
+    , m_log(-1)
+    , m_pending()
+    , m_unsynced(0)
+    , m_logged(0)
+{
+    if (m_options.sync_every == 0)
+        throw std::invalid_argument("sync_every must be at least 1");
+
+    struct stat status;
+    if (::stat(m_snapshot.c_str(), &status) == 0)
+        m_map.LoadBinary(m_snapshot);
+
+    // the destructor does not run for a constructor that throws, the log has to be closed here
+    try {
+        OpenLog();
+        Replay();
+    } catch (...) {
+        if (m_log >= 0)
+            ::close(m_log);
+
+        throw;
+    }
+}
+
+template <class Key, class Value> DurableMap<Key, Value>::~DurableMap()
+{
+    // whatever could not be synced here is lost like in a crash, a destructor must not throw
+    try {
+        Sync();
+    } catch (...) {
+    }
+
+    ::close(m_log);
+}
+
+template <class Key, class Value> Value DurableMap<Key, Value>::At(const Key& key) const
+{
+    return m_map.At(key);
+}
+
+template <class Key, class Value>
+const Value* DurableMap<Key, Value>::Find(const Key& key) const
+{
+    return m_map.Find(key);
+}
+
+template <class Key, class Value> bool DurableMap<Key, Value>::Contains(const Key& key) const
+{
+    return m_map.Contains(key);
+}
+
+template <class Key, class Value>
+void DurableMap<Key, Value>::Insert(const Key& key, const Value& value)
+{
+    Log(Operation::INSERT, key, &value);
+    m_map.Insert(key, value);
+
+    if (m_options.checkpoint_every != 0 && m_logged >= m_options.checkpoint_every)
+        Checkpoint();
+}
+
+template <class Key, class Value> void DurableMap<Key, Value>::Remove(const Key& key)
+{
+    Log(Operation::REMOVE, key, nullptr);
+    m_map.Remove(key);
+
+    if (m_options.checkpoint_every != 0 && m_logged >= m_options.checkpoint_every)
+        Checkpoint();
+}
+
+template <class Key, class Value> std::size_t DurableMap<Key, Value>::Size() const
+{
+    return m_map.Size();
+}
+
+template <class Key, class Value> void DurableMap<Key, Value>::Sync()
+{
+    if (m_pending.empty())
+        return;
+
+    Write(m_pending.data(), m_pending.size());
+    m_pending.clear();
+    m_unsynced = 0;
+
+    if (::fdatasync(m_log) != 0)
+        throw std::runtime_error("cannot sync log: " + m_log_path);
+}
+
+// a crash after the snapshot is renamed in but before the log is emptied replays the old log on
+// the new snapshot, which changes nothing: the last update of every key is already in it
+template <class Key, class Value> void DurableMap<Key, Value>::Checkpoint()
+{
+    Sync();
+    m_map.SaveBinary(m_snapshot);
+    SyncDirectory();
+
+    if (::ftruncate(m_log, sizeof(LogHeader)) != 0
+        || ::lseek(m_log, sizeof(LogHeader), SEEK_SET) < 0 || ::fdatasync(m_log) != 0)
+        throw std::runtime_error("cannot truncate log: " + m_log_path);
+
+    m_logged = 0;
+}
+
+template <class Key, class Value> void DurableMap<Key, Value>::OpenLog()
+{
+    m_log = ::open(m_log_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_log < 0)
+        throw std::runtime_error("cannot open log: " + m_log_path);
+
+    LogHeader header {};
+    const ssize_t bytes = ::pread(m_log, &header, sizeof(header), 0);
+
+    if (bytes == 0) {
+        header = LogHeader { LogHeader::kMagic, sizeof(Key), sizeof(Value) };
+        Write(reinterpret_cast<const unsigned char*>(&header), sizeof(header));
+
+        if (::fdatasync(m_log) != 0)
+            throw std::runtime_error("cannot sync log: " + m_log_path);
+
+        SyncDirectory();
+        return;
+    }
+
+    if (bytes != static_cast<ssize_t>(sizeof(header)) || header.magic != LogHeader::kMagic
+        || header.key_size != sizeof(Key) || header.value_size != sizeof(Value)) {
+        throw std::runtime_error("not a map log of these key and value types: " + m_log_path);
+    }
+}
+
+template <class Key, class Value> void DurableMap<Key, Value>::Replay()
+{
+    using BatchOp = typename Map<Key, Value>::BatchOp;
+
+    std::vector<unsigned char> buffer(kReplayBatch * kRecordSize);
+    off_t offset = sizeof(LogHeader);
+    bool done = false;
+
+    while (!done) {
+        // a short read only happens at the end of the file
+        std::size_t filled = 0;
+        while (filled < buffer.size()) {
+            const ssize_t bytes
+                = ::pread(m_log, buffer.data() + filled, buffer.size() - filled, offset + filled);
+
+            if (bytes < 0 && errno == EINTR)
+                continue;
+
+            if (bytes < 0)
+                throw std::runtime_error("cannot read log: " + m_log_path);
+
+            if (bytes == 0)
+                break;
+
+            filled += static_cast<std::size_t>(bytes);
+        }
+
+        std::vector<BatchOp> ops;
+        ops.reserve(filled / kRecordSize);
+
+        std::size_t used = 0;
+        for (; used + kRecordSize <= filled; used += kRecordSize) {
+            const unsigned char* record = buffer.data() + used;
+
+            std::uint64_t checksum;
+            std::memcpy(&checksum, record + kPayloadSize, sizeof(checksum));
+
+            if (SnapshotChecksum::Update(SnapshotChecksum::kOffsetBasis, record, kPayloadSize)
+                != checksum) {
+                done = true;
+                break;
+            }
+
+            BatchOp op {};
+            std::memcpy(&op.key, record + 1, sizeof(Key));
+
+            if (record[0] == static_cast<unsigned char>(Operation::INSERT)) {
+                op.value.emplace();
+                std::memcpy(&*op.value, record + 1 + sizeof(Key), sizeof(Value));
+            }
+
+            ops.push_back(std::move(op));
+        }
+
+        m_map.ApplyBatch(std::move(ops));
+        m_logged += used / kRecordSize;
+        offset += static_cast<off_t>(used);
+
+        if (filled < buffer.size())
+            done = true;
+    }
+
+    // appends go right after the last complete record, over whatever the crash left behind it
+    if (::ftruncate(m_log, offset) != 0 || ::lseek(m_log, offset, SEEK_SET) < 0)
+        throw std::runtime_error("cannot truncate log: " + m_log_path);
+}
+
+template <class Key, class Value>
+void DurableMap<Key, Value>::Log(const Operation operation, const Key& key, const Value* value)
+{
+    const std::size_t start = m_pending.size();
+    m_pending.resize(start + kRecordSize);
+    unsigned char* record = m_pending.data() + start;
+
+    record[0] = static_cast<unsigned char>(operation);
+    std::memcpy(record + 1, &key, sizeof(Key));
+
+    if (value != nullptr)
+        std::memcpy(record + 1 + sizeof(Key), value, sizeof(Value));
+    else
+        std::memset(record + 1 + sizeof(Key), 0, sizeof(Value));
+
+    const std::uint64_t checksum
+        = SnapshotChecksum::Update(SnapshotChecksum::kOffsetBasis, record, kPayloadSize);
+    std::memcpy(record + kPayloadSize, &checksum, sizeof(checksum));
+
+    m_logged++;
+
+    if (++m_unsynced >= m_options.sync_every)
+        Sync();
+}
+
+template <class Key, class Value>
+void DurableMap<Key, Value>::Write(const unsigned char* data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t written = ::write(m_log, data, size);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written < 0)
+            throw std::runtime_error("cannot write log: " + m_log_path);
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+// a new or renamed file is only durable once the directory entry pointing at it is
+template <class Key, class Value> void DurableMap<Key, Value>::SyncDirectory() const
+{
+    const int fd = ::open(m_directory.c_str(), O_RDONLY);
+    const bool synced = fd >= 0 && ::fsync(fd) == 0;
+
+    if (fd >= 0)
+        ::close(fd);
+
+    if (!synced)
+        throw std::runtime_error("cannot sync directory: " + m_directory);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/*
+ * Immutable snapshot of a Map, created by Map::Freeze().
+ *
+ * Keys and values are kept in two arrays in Eytzinger order: the children of slot k are slots 2k
+ * and 2k + 1, the root is slot 1. A lookup walks down with one comparison and no branch per
+ * level, and since the descendants four levels down sit next to each other they are prefetched
+ * while the walk is still at the top.
+ */
+template <class Key, class Value> class FrozenMap {
+    template <class K, class V, class A, class G, class S> friend class Map;
+
+    static constexpr std::size_t kCacheLine = 64;
+    // 2^4 = 16 descendants of int keys share a line, so prefetch four levels ahead
+    static constexpr std::size_t kPrefetchStride
+        = (sizeof(Key) < kCacheLine) ? kCacheLine / sizeof(Key) : 1;
+
+public:
+    class Iterator {
+        friend class FrozenMap;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<const Key, Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const Key&, const Value&>;
+
+        // keys and values are apart, so -> has to point into a temporary pair of references
+        struct pointer {
+            reference entry;
+            const reference* operator->() const { return &entry; }
+        };
+
+        Iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        Iterator& operator--();
+        Iterator operator--(int);
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        Iterator(const std::size_t index, const FrozenMap* map);
+
+        std::size_t m_index;
+        const FrozenMap* m_map;
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+
+    FrozenMap();
+
+    Value At(const Key& key) const;
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    std::size_t Size() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    std::size_t MemoryUsage() const;
+
+private:
+    template <class InputIt> FrozenMap(InputIt first, const std::size_t n);
+
+    std::size_t LowerBoundIndex(const Key& key) const;
+    std::size_t First() const;
+    std::size_t Last() const;
+    std::size_t Next(std::size_t index) const;
+    std::size_t Previous(std::size_t index) const;
+
+private:
+    std::less<Key> m_comparator;
+    // slot 0 is unused so that the children arithmetic works from 1, index 0 means "no slot"
+    std::vector<Key> m_keys;
+    std::vector<Value> m_values;
+    std::size_t m_size;
+};
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "frozen_map.h"
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+template <class Key, class Value>
+FrozenMap<Key, Value>::FrozenMap()
+    : m_comparator()
+    , m_keys(1)
+    , m_values(1)
+    , m_size(0)
+{
+}
+
+// the in-order walk over the slots visits them in key order, so a sorted input fills the
+// layout in one pass
+template <class Key, class Value>
+template <class InputIt>
+FrozenMap<Key, Value>::FrozenMap(InputIt first, const std::size_t n)
+    : m_comparator()
+    , m_keys(n + 1)
+    , m_values(n + 1)
+    , m_size(n)
+{
+    for (std::size_t index = First(); index != 0; index = Next(index), ++first) {
+        m_keys[index] = first->first;
+        m_values[index] = first->second;
+    }
+}
+
+template <class Key, class Value> Value FrozenMap<Key, Value>::At(const Key& key) const
+{
+    const Value* value = Find(key);
+
+    if (value == nullptr) {
+        if constexpr (std::is_arithmetic_v<Key>)
+            throw std::out_of_range("invalid key: " + std::to_string(key));
+        else
+            throw std::out_of_range("invalid key");
+    }
+
+    return *value;
+}
+
+template <class Key, class Value>
+const Value* FrozenMap<Key, Value>::Find(const Key& key) const
+{
+    const std::size_t index = LowerBoundIndex(key);
+
+    if (index == 0 || m_comparator(key, m_keys[index]))
+        return nullptr;
+
+    return &m_values[index];
+}
+
+template <class Key, class Value> bool FrozenMap<Key, Value>::Contains(const Key& key) const
+{
+    return Find(key) != nullptr;
+}
+
+template <class Key, class Value> std::size_t FrozenMap<Key, Value>::Size() const
+{
+    return m_size;
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::const_iterator FrozenMap<Key, Value>::begin() const
+{
+    return const_iterator(First(), this);
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::const_iterator FrozenMap<Key, Value>::end() const
+{
+    return const_iterator(0, this);
+}
+
+template <class Key, class Value> std::size_t FrozenMap<Key, Value>::MemoryUsage() const
+{
+    return sizeof(*this) + m_keys.capacity() * sizeof(Key) + m_values.capacity() * sizeof(Value);
+}
+
+template <class Key, class Value>
+std::size_t FrozenMap<Key, Value>::LowerBoundIndex(const Key& key) const
+{
+    const Key* keys = m_keys.data();
+    std::size_t index = 1;
+
+    while (index <= m_size) {
+        // only a hint, the address may lie past the end of the array
+        __builtin_prefetch(keys + kPrefetchStride * index);
+        index = 2 * index + m_comparator(keys[index], key);
+    }
+
+    // every right turn after the last left turn went past keys smaller than key, dropping them
+    // and that left turn leaves the smallest key not less than key, or 0 when there is none
+    index >>= __builtin_ffsll(static_cast<long long>(~index));
+
+    return index;
+}
+
+template <class Key, class Value> std::size_t FrozenMap<Key, Value>::First() const
+{
+    if (m_size == 0)
+        return 0;
+
+    std::size_t index = 1;
+    while (2 * index <= m_size)
+        index = 2 * index;
+
+    return index;
+}
+
+template <class Key, class Value> std::size_t FrozenMap<Key, Value>::Last() const
+{
+    if (m_size == 0)
+        return 0;
+
+    std::size_t index = 1;
+    while (2 * index + 1 <= m_size)
+        index = 2 * index + 1;
+
+    return index;
+}
+
+template <class Key, class Value>
+std::size_t FrozenMap<Key, Value>::Next(std::size_t index) const
+{
+    if (2 * index + 1 <= m_size) {
+        index = 2 * index + 1;
+        while (2 * index <= m_size)
+            index = 2 * index;
+
+        return index;
+    }
+
+    // climb while we are a right child, the parent of the first left child comes next
+    while (index & 1)
+        index >>= 1;
+
+    return index >> 1;
+}
+
+template <class Key, class Value>
+std::size_t FrozenMap<Key, Value>::Previous(std::size_t index) const
+{
+    if (index == 0)
+        return Last();
+
+    if (2 * index <= m_size) {
+        index = 2 * index;
+        while (2 * index + 1 <= m_size)
+            index = 2 * index + 1;
+
+        return index;
+    }
+
+    while (index != 0 && (index & 1) == 0)
+        index >>= 1;
+
+    return index >> 1;
+}
+
+template <class Key, class Value>
+FrozenMap<Key, Value>::Iterator::Iterator()
+    : m_index(0)
+    , m_map(nullptr)
+{
+}
+
+template <class Key, class Value>
+FrozenMap<Key, Value>::Iterator::Iterator(const std::size_t index, const FrozenMap* map)
+    : m_index(index)
+    , m_map(map)
+{
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator::reference
+FrozenMap<Key, Value>::Iterator::operator*() const
+{
+    return reference(m_map->m_keys[m_index], m_map->m_values[m_index]);
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator::pointer
+FrozenMap<Key, Value>::Iterator::operator->() const
+{
+    return pointer { **this };
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator& FrozenMap<Key, Value>::Iterator::operator++()
+{
+    m_index = m_map->Next(m_index);
+
+    return *this;
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator FrozenMap<Key, Value>::Iterator::operator++(int)
+{
+    Iterator next = *this;
+    m_index = m_map->Next(m_index);
+
+    return next;
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator& FrozenMap<Key, Value>::Iterator::operator--()
+{
+    m_index = m_map->Previous(m_index);
+
+    return *this;
+}
+
+template <class Key, class Value>
+typename FrozenMap<Key, Value>::Iterator FrozenMap<Key, Value>::Iterator::operator--(int)
+{
+    Iterator previous = *this;
+    m_index = m_map->Previous(m_index);
+
+    return previous;
+}
+
+template <class Key, class Value>
+bool FrozenMap<Key, Value>::Iterator::operator==(const Iterator& other) const
+{
+    return m_index == other.m_index;
+}
+
+template <class Key, class Value>
+bool FrozenMap<Key, Value>::Iterator::operator!=(const Iterator& other) const
+{
+    return m_index != other.m_index;
+}
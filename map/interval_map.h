@@ -0,0 +1,70 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "augmentation.h"
+#include "map.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/*
+ * Map from half-open [start, end) intervals to values, with overlap queries.
+ *
+ * The intervals are the keys of a Map ordered by start, then by end, so the same interval is
+ * stored once and inserting it again replaces its value. Every node also keeps the largest end in
+ * its subtree (MaxEndpoint), which Map's rotations and remove fix-up keep up to date like any
+ * other augmentation.
+ *
+ * Overlapping() walks the tree in start order and skips every subtree whose largest end is not
+ * past the query, and everything right of the first start that is not before it. It calls the
+ * visitor with the intervals it finds in start order, on the stack of the caller, so a query
+ * allocates nothing. A query costs O(log n) plus at most O(log n) per interval reported, much less
+ * when the reported intervals sit close together in the tree.
+ */
+template <class Point, class Value> class IntervalMap {
+
+    using Interval = std::pair<Point, Point>;
+    using Tree = Map<Interval, Value, std::allocator<std::pair<const Interval, Value>>,
+                     MaxEndpoint<Point>>;
+    using Node = typename Tree::Node;
+
+public:
+    IntervalMap() = default;
+
+    Value* Find(const Point& start, const Point& end);
+    const Value* Find(const Point& start, const Point& end) const;
+    bool Contains(const Point& start, const Point& end) const;
+    void Insert(const Point& start, const Point& end, const Value& value);
+    void Remove(const Point& start, const Point& end);
+    std::size_t Size() const;
+    void Clear();
+    template <class Function> void ForEach(Function fn) const;
+    template <class Function> void Overlapping(const Point& point, Function fn) const;
+    template <class Function>
+    void Overlapping(const Point& lo, const Point& hi, Function fn) const;
+    std::size_t MemoryUsage() const;
+
+private:
+    template <class StartsBefore, class Function>
+    void Overlapping(const Node* node, const Point& lo, StartsBefore& starts_before,
+                     Function& fn) const;
+
+private:
+    std::less<Point> m_comparator;
+    Tree m_tree;
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "interval_map.h"
+#include "map.hpp"
+#include <stdexcept>
+
+template <class Point, class Value>
+Value* IntervalMap<Point, Value>::Find(const Point& start, const Point& end)
+{
+    return m_tree.Find(Interval(start, end));
+}
+
+template <class Point, class Value>
+const Value* IntervalMap<Point, Value>::Find(const Point& start, const Point& end) const
+{
+    return m_tree.Find(Interval(start, end));
+}
+
+template <class Point, class Value>
+bool IntervalMap<Point, Value>::Contains(const Point& start, const Point& end) const
+{
+    return m_tree.Contains(Interval(start, end));
+}
+
+// an empty interval overlaps nothing, it could be stored but never found by Overlapping()
+template <class Point, class Value>
+void IntervalMap<Point, Value>::Insert(const Point& start, const Point& end, const Value& value)
+{
+    if (!m_comparator(start, end))
+        throw std::invalid_argument("interval end is not after its start");
+
+    m_tree.InsertOrAssign(Interval(start, end), value);
+}
+
+template <class Point, class Value>
+void IntervalMap<Point, Value>::Remove(const Point& start, const Point& end)
+{
+    m_tree.Remove(Interval(start, end));
+}
+
+template <class Point, class Value> std::size_t IntervalMap<Point, Value>::Size() const
+{
+    return m_tree.Size();
+}
+
+template <class Point, class Value> void IntervalMap<Point, Value>::Clear() { m_tree.Clear(); }
+
+template <class Point, class Value>
+template <class Function>
+void IntervalMap<Point, Value>::ForEach(Function fn) const
+{
+    for (const auto& entry : m_tree)
+        fn(entry.first.first, entry.first.second, entry.second);
+}
+
+// the intervals with start <= point < end
+template <class Point, class Value>
+template <class Function>
+void IntervalMap<Point, Value>::Overlapping(const Point& point, Function fn) const
+{
+    auto starts_before = [this, &point](const Point& start) {
+        return !m_comparator(point, start);
+    };
+
+    Overlapping(m_tree.m_root, point, starts_before, fn);
+}
+
+// the intervals with start < hi and lo < end
+template <class Point, class Value>
+template <class Function>
+void IntervalMap<Point, Value>::Overlapping(const Point& lo, const Point& hi, Function fn) const
+{
+    if (!m_comparator(lo, hi))
+        return;
+
+    auto starts_before = [this, &hi](const Point& start) { return m_comparator(start, hi); };
+
+    Overlapping(m_tree.m_root, lo, starts_before, fn);
+}
+
+template <class Point, class Value> std::size_t IntervalMap<Point, Value>::MemoryUsage() const
+{
+    return m_tree.MemoryUsage();
+}
+
+// a subtree whose largest end is not after lo has nothing to report. Once a start is not before
+// the query neither is any start right of it, and the walk stops.
+template <class Point, class Value>
+template <class StartsBefore, class Function>
+void IntervalMap<Point, Value>::Overlapping(const Node* node, const Point& lo,
+                                            StartsBefore& starts_before, Function& fn) const
+{
+    if (node == m_tree.m_sentinel || !m_comparator(lo, node->max_end))
+        return;
+
+    Overlapping(node->left, lo, starts_before, fn);
+
+    const Interval& interval = node->entry.first;
+
+    if (!starts_before(interval.first))
+        return;
+
+    if (m_comparator(lo, interval.second))
+        fn(interval.first, interval.second, static_cast<const Value&>(node->entry.second));
+
+    Overlapping(node->right, lo, starts_before, fn);
+}
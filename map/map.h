@@ -15,56 +15,264 @@
  */
 #pragma once
 
+#include "augmentation.h"
+#include "frozen_map.h"
+#include "mapped_map.h"
+#include "node_pool.h"
+#include "stats.h"
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 enum class Color { RED = 0, BLACK };
 
-template <class Key, class Value> class Map {
+// VERIFY rejects input that is not strictly increasing, ASSUME only checks it in debug builds
+enum class SortedMode { VERIFY = 0, ASSUME };
 
-    struct Node {
-        Key key;
-        Value value;
-        Node* parent;
+template <class Key, class Value,
+          class Allocator = std::allocator<std::pair<const Key, Value>>,
+          class Augmentation = NoAugmentation, class Stats = NoStats>
+class Map {
+    template <class P, class V> friend class IntervalMap;
+
+    // the color lives in the lowest bit of the parent pointer, which is always zero because of
+    // the node alignment
+    using Entry = std::pair<const Key, Value>;
+    using Summary = typename Augmentation::Summary;
+
+    // the summary is a base so that an empty one takes no space
+    struct Node : Summary {
+        template <class... Args>
+        Node(const std::uintptr_t parent_color, Node* left, Node* right, Args&&... args);
+
+        Entry entry;
+        std::uintptr_t parent_color;
         Node* left;
         Node* right;
-        Color color;
-        int id;
     };
 
+    static constexpr std::uintptr_t kColorMask = 1;
+    // lookups LookupBatch() keeps in flight, enough misses to cover the memory latency
+    static constexpr std::size_t kBatchWidth = 16;
+    // ApplyBatch() rebuilds the whole tree once the batch is at least 1/kDenseBatchRatio of it
+    static constexpr std::size_t kDenseBatchRatio = 8;
+    // BuildParallel() does not hand a sort run or a subtree smaller than this to its own thread,
+    // the set operations stay on one thread for maps smaller than this
+    static constexpr std::size_t kParallelGrain = 1 << 16;
+    static_assert(alignof(Node) > kColorMask, "node alignment leaves no room for the color bit");
+
     using NodePtr = Node*;
     using ConstNodePtr = const NodePtr;
     using ConstColor = const Color;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using Pool = NodePool<Node, NodeAllocator>;
+    using Entries = std::vector<std::pair<Key, Value>>;
 
     struct SearchResult {
         NodePtr node = nullptr;
         NodePtr parent = nullptr;
     };
 
+    // a subtree handled on its own by the set operations, with the number of black nodes on its
+    // paths down to the sentinel
+    struct Tree {
+        NodePtr root;
+        std::size_t black_height;
+    };
+
+    // node is the detached one with the key split at, or nullptr
+    struct SplitResult {
+        Tree left;
+        NodePtr node;
+        Tree right;
+    };
+
 public:
-    Map();
+    template <bool IsConst> class Iterator {
+        friend class Map;
+        template <bool> friend class Iterator;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::conditional_t<IsConst, const Entry&, Entry&>;
+        using pointer = std::conditional_t<IsConst, const Entry*, Entry*>;
+
+        Iterator();
+        Iterator(const Iterator<false>& other);
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        Iterator& operator--();
+        Iterator operator--(int);
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        Iterator(NodePtr node, const Map* map);
+
+        NodePtr m_node;
+        const Map* m_map;
+    };
+
+    // owns a node taken out of a map by Extract() until it is handed to Insert(), together with
+    // a share of the slabs it was carved from so that it stays valid after that map is gone.
+    // Insert() links the node itself in, without allocating, when the allocators of the two maps
+    // compare equal; otherwise it copies the key and moves the value into a node of its own.
+    // The target then keeps every slab of the source map alive until it is cleared itself. A
+    // handle that is dropped gives the slot back to the map it came from.
+    class NodeHandle {
+        friend class Map;
+
+    public:
+        NodeHandle();
+        NodeHandle(const NodeHandle& other) = delete;
+        NodeHandle& operator=(const NodeHandle& other) = delete;
+        NodeHandle(NodeHandle&& other) noexcept;
+        NodeHandle& operator=(NodeHandle&& other) noexcept;
+        ~NodeHandle();
+
+        bool Empty() const;
+        const Key& GetKey() const;
+        Value& GetValue();
+
+    private:
+        NodeHandle(NodePtr node, typename Pool::Share&& share);
+        void Reset();
+
+        NodePtr m_node;
+        typename Pool::Share m_share;
+    };
+
+    // one update for ApplyBatch(), an empty value removes the key
+    struct BatchOp {
+        Key key;
+        std::optional<Value> value;
+    };
+
+    // the default merge of Union() and Intersection(): the value from the other map wins
+    struct KeepTheirs {
+        const Value& operator()(const Value& /* ours */, const Value& theirs) const
+        {
+            return theirs;
+        }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    explicit Map(const Allocator& allocator = Allocator());
+    template <class ForwardIt>
+    Map(ForwardIt first, ForwardIt last, const SortedMode mode = SortedMode::VERIFY,
+        const Allocator& allocator = Allocator());
     Map(const Map& other);
     Map& operator=(const Map& other);
     Map(Map&& other);
     Map& operator=(Map&& other);
     ~Map();
 
-    Value At(const Key& key);
+    Value At(const Key& key) const;
+    Value* Find(const Key& key);
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    bool TryGet(const Key& key, Value& out) const;
+    std::size_t LookupBatch(const Key* keys, const std::size_t count, Value* out,
+                            bool* found) const;
+    iterator LowerBound(const Key& key);
+    const_iterator LowerBound(const Key& key) const;
+    iterator UpperBound(const Key& key);
+    const_iterator UpperBound(const Key& key) const;
+    std::pair<iterator, iterator> EqualRange(const Key& key);
+    std::pair<const_iterator, const_iterator> EqualRange(const Key& key) const;
+    template <class Function> void ForEachInRange(const Key& lo, const Key& hi, Function fn);
+    template <class Function>
+    void ForEachInRange(const Key& lo, const Key& hi, Function fn) const;
+    std::size_t Rank(const Key& key) const;
+    iterator Select(const std::size_t index);
+    const_iterator Select(const std::size_t index) const;
+    std::size_t CountRange(const Key& lo, const Key& hi) const;
+    auto Aggregate(const Key& lo, const Key& hi) const;
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    reverse_iterator rbegin();
+    const_reverse_iterator rbegin() const;
+    reverse_iterator rend();
+    const_reverse_iterator rend() const;
     void Insert(const Key& key, const Value& value);
+    std::pair<iterator, bool> Insert(NodeHandle&& node);
+    template <class... Args> std::pair<iterator, bool> Emplace(Args&&... args);
+    template <class... Args> std::pair<iterator, bool> TryEmplace(const Key& key, Args&&... args);
+    template <class... Args> std::pair<iterator, bool> TryEmplace(Key&& key, Args&&... args);
+    template <class M> std::pair<iterator, bool> InsertOrAssign(const Key& key, M&& value);
+    template <class M> std::pair<iterator, bool> InsertOrAssign(Key&& key, M&& value);
+    NodeHandle Extract(const Key& key);
+    void ApplyBatch(std::vector<BatchOp> ops);
+    template <class ForwardIt>
+    void ApplySortedBatch(ForwardIt first, ForwardIt last,
+                          const SortedMode mode = SortedMode::VERIFY);
     void Remove(const Key& key);
     std::size_t Size() const;
+    void Reserve(const std::size_t n);
+    void Clear();
+    template <class ForwardIt>
+    void BuildFromSorted(ForwardIt first, ForwardIt last,
+                         const SortedMode mode = SortedMode::VERIFY);
+    template <class InputIt>
+    void BuildParallel(InputIt first, InputIt last,
+                       const std::size_t threads = std::thread::hardware_concurrency());
+    template <class Merge = KeepTheirs>
+    void Union(Map&& other, Merge merge = Merge(),
+               const std::size_t threads = std::thread::hardware_concurrency());
+    template <class Merge = KeepTheirs>
+    void Intersection(const Map& other, Merge merge = Merge(),
+                      const std::size_t threads = std::thread::hardware_concurrency());
+    void Difference(const Map& other,
+                    const std::size_t threads = std::thread::hardware_concurrency());
+    FrozenMap<Key, Value> Freeze() const;
     std::size_t MaxDepth(NodePtr root = nullptr, const bool first_node = true);
     void SaveTree(const std::string& filename) const;
+    void SaveBinary(const std::string& filename) const;
+    void LoadBinary(const std::string& filename, const ChecksumMode mode = ChecksumMode::VERIFY);
+    static constexpr std::size_t NodeBytes();
+    std::size_t MemoryUsage() const;
 
 private:
-    NodePtr CreateNode(ConstNodePtr parent, const Key& key, const Value& value,
-                       ConstColor color = Color::RED);
-    SearchResult Search(const Key& key, ConstNodePtr root, ConstNodePtr parent);
+    template <class... Args>
+    NodePtr CreateNode(ConstNodePtr parent, ConstColor color, Args&&... args);
+    void Attach(NodePtr new_node, NodePtr parent);
+    void RemoveNode(NodePtr node);
+    void Unlink(NodePtr node);
+    SearchResult Search(const Key& key, const MapOperation operation,
+                        NodePtr finger = nullptr) const;
+    NodePtr FindNode(const Key& key, const MapOperation operation) const;
+    NodePtr LowerBoundNode(const Key& key) const;
+    NodePtr UpperBoundNode(const Key& key) const;
+    NodePtr Successor(NodePtr node) const;
+    NodePtr Predecessor(NodePtr node) const;
     void LeftRotate(ConstNodePtr x);
     void RightRotate(ConstNodePtr x);
     void Recolor(NodePtr new_node, NodePtr uncle_node);
+    inline static std::uintptr_t Link(ConstNodePtr parent, ConstColor color);
+    inline static NodePtr Parent(const Node* node);
+    inline static void SetParent(ConstNodePtr node, ConstNodePtr parent);
+    inline static Color GetColor(const Node* node);
+    inline static void SetColor(ConstNodePtr node, ConstColor color);
     inline bool LeafNode(ConstNodePtr node);
     inline bool HasOnlyLeftChild(ConstNodePtr node);
     inline bool HasOnlyRightChild(ConstNodePtr node);
@@ -74,16 +282,73 @@ private:
     inline void Transplant(NodePtr x, NodePtr y);
     inline static NodePtr Sibling(ConstNodePtr node);
     void DeleteTree(NodePtr node);
-    void CopyNode(NodePtr node, NodePtr sentinel);
+    void CopyTree(const Map& other);
+    template <class ForwardIt> bool StrictlyIncreasing(ForwardIt first, ForwardIt last) const;
+    template <class ForwardIt> bool SortedByKey(ForwardIt first, ForwardIt last) const;
+    template <class ForwardIt> void ApplySweep(ForwardIt first, ForwardIt last);
+    template <class ForwardIt> void MergeAndRebuild(ForwardIt first, ForwardIt last);
+    void SortByKey(Entries& entries, const std::size_t threads) const;
+    template <class Function> static void RunParallel(const std::size_t count, Function fn);
+    inline static std::size_t RedDepth(const std::size_t n);
+    template <class ForwardIt>
+    NodePtr BuildSubtree(ForwardIt& first, const std::size_t n, const std::size_t depth,
+                         const std::size_t red_depth, Pool& pool);
+    template <class RandomIt>
+    NodePtr BuildSubtreeParallel(RandomIt first, const std::size_t n, const std::size_t depth,
+                                 const std::size_t red_depth, Pool* pools,
+                                 const std::size_t threads);
+    void Swap(Map& other);
+    void SetRoot(NodePtr root);
+    inline static Summary& SummaryOf(ConstNodePtr node);
+    inline void Refresh(ConstNodePtr node);
+    void RefreshPath(NodePtr node);
+    NodePtr SelectNode(std::size_t index) const;
+    Tree AdoptTree(Map& other);
+    void Retarget(NodePtr node, const Node* old_sentinel);
+    std::size_t ReleaseNodes(const std::vector<NodePtr>& roots);
+    std::size_t BlackHeight(const Node* root) const;
+    inline static std::size_t Workers(const std::size_t threads, const std::size_t n);
+    Tree Join(const Tree& left, NodePtr node, const Tree& right);
+    NodePtr JoinRight(NodePtr left, const std::size_t left_height, NodePtr node,
+                      const Tree& right);
+    NodePtr JoinLeft(const Tree& left, NodePtr node, NodePtr right,
+                     const std::size_t right_height);
+    Tree Join(const Tree& left, const Tree& right);
+    NodePtr RotatedLeft(NodePtr x);
+    NodePtr RotatedRight(NodePtr x);
+    SplitResult Split(const Tree& tree, const Key& key);
+    std::pair<Tree, NodePtr> SplitLast(const Tree& tree);
+    template <class LeftFn, class RightFn>
+    static std::pair<Tree, Tree> Fork(const std::size_t threads, std::vector<NodePtr>& dropped,
+                                      LeftFn left, RightFn right);
+    template <class Merge>
+    Tree UnionTrees(const Tree& ours, const Tree& theirs, Merge& merge, const bool swapped,
+                    const std::size_t threads, std::vector<NodePtr>& dropped);
+    template <class Merge>
+    Tree IntersectTrees(const Tree& ours, const Node* theirs, const Map& other, Merge& merge,
+                        const std::size_t threads, std::vector<NodePtr>& dropped);
+    Tree DifferenceTrees(const Tree& ours, const Node* theirs, const Map& other,
+                         const std::size_t threads, std::vector<NodePtr>& dropped);
 
 private:
     std::less<Key> m_comparator;
+    Pool m_pool;
     NodePtr m_root;
     NodePtr m_sentinel;
     std::size_t m_size;
 };
 
-std::ostream& operator<<(std::ostream& os, const Color color)
+// Map that keeps subtree sizes, for Rank(), Select() and CountRange()
+template <class Key, class Value>
+using OrderStatisticsMap
+    = Map<Key, Value, std::allocator<std::pair<const Key, Value>>, OrderStatistics>;
+
+// Map that folds its values with Monoid, for Aggregate()
+template <class Key, class Value, class Monoid>
+using AggregateMap
+    = Map<Key, Value, std::allocator<std::pair<const Key, Value>>, Aggregation<Monoid>>;
+
+inline std::ostream& operator<<(std::ostream& os, const Color color)
 {
     if (color == Color::RED)
         os << "red";
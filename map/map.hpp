@@ -16,50 +16,84 @@
 #pragma once
 
 #include "map.h"
+#include "frozen_map.hpp"
+#include "mapped_map.hpp"
+#include "node_pool.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cassert>
 #include <fstream>
+#include <future>
+#include <iterator>
 #include <queue>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
-template <class Key, class Value>
-Map<Key, Value>::Map()
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::Map(const Allocator& allocator)
     : m_comparator()
+    , m_pool(NodeAllocator(allocator))
     , m_root(nullptr)
     , m_sentinel(nullptr)
     , m_size(0)
 {
-    m_sentinel = new Node { Key(), Value(), nullptr, nullptr, nullptr, Color::BLACK };
+    m_sentinel = new Node(Link(nullptr, Color::BLACK), nullptr, nullptr);
     m_root = m_sentinel;
 }
 
-template <class Key, class Value>
-Map<Key, Value>::Map(const Map& other)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+Map<Key, Value, Allocator, Augmentation, Stats>::Map(ForwardIt first, ForwardIt last,
+                                                     const SortedMode mode,
+                                                     const Allocator& allocator)
+    : Map(allocator)
+{
+    BuildFromSorted(first, last, mode);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::Map(const Map& other)
     : m_comparator()
+    , m_pool(std::allocator_traits<NodeAllocator>::select_on_container_copy_construction(
+          other.m_pool.GetAllocator()))
     , m_root(nullptr)
     , m_sentinel(nullptr)
     , m_size(0)
 {
-    m_sentinel = new Node { Key(), Value(), nullptr, nullptr, nullptr, Color::BLACK };
+    m_sentinel = new Node(Link(nullptr, Color::BLACK), nullptr, nullptr);
     m_root = m_sentinel;
 
-    CopyNode(other.m_root, other.m_sentinel);
+    CopyTree(other);
 }
 
-template <class Key, class Value> Map<Key, Value>& Map<Key, Value>::operator=(const Map& other)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>&
+Map<Key, Value, Allocator, Augmentation, Stats>::operator=(const Map& other)
 {
+    using Traits = std::allocator_traits<NodeAllocator>;
+
     if (this != &other) {
-        DeleteTree(m_root);
-        m_root = m_sentinel;
+        Clear();
 
-        CopyNode(other.m_root, other.m_sentinel);
+        // like the standard containers, the allocator of other comes along when it asks to
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (m_pool.GetAllocator() != other.m_pool.GetAllocator())
+                m_pool = Pool(other.m_pool.GetAllocator());
+        }
+
+        CopyTree(other);
     }
 
     return *this;
 }
 
-template <class Key, class Value>
-Map<Key, Value>::Map(Map&& other)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::Map(Map&& other)
     : m_comparator()
+    , m_pool(std::move(other.m_pool))
     , m_root(other.m_root)
     , m_sentinel(other.m_sentinel)
     , m_size(other.m_size)
@@ -69,12 +103,15 @@ Map<Key, Value>::Map(Map&& other)
     other.m_size = 0;
 }
 
-template <class Key, class Value> Map<Key, Value>& Map<Key, Value>::operator=(Map&& other)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>&
+Map<Key, Value, Allocator, Augmentation, Stats>::operator=(Map&& other)
 {
     if (this != &other) {
-        DeleteTree(m_root);
+        Clear();
         delete m_sentinel;
 
+        m_pool = std::move(other.m_pool);
         m_root = other.m_root;
         m_sentinel = other.m_sentinel;
         m_size = other.m_size;
@@ -87,388 +124,2177 @@ template <class Key, class Value> Map<Key, Value>& Map<Key, Value>::operator=(Ma
     return *this;
 }
 
-template <class Key, class Value> Map<Key, Value>::~Map()
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::~Map()
 {
     DeleteTree(m_root);
+    m_pool.Release();
     m_root = nullptr;
     delete m_sentinel;
 }
 
-template <class Key, class Value> Value Map<Key, Value>::At(const Key& key)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Value Map<Key, Value, Allocator, Augmentation, Stats>::At(const Key& key) const
 {
-    SearchResult result = Search(key, m_root, nullptr);
+    NodePtr node = FindNode(key, MapOperation::LOOKUP);
 
-    if (result.node == m_sentinel)
-        throw std::out_of_range("invalid key: " + std::to_string(key));
+    if (node == m_sentinel) {
+        if constexpr (std::is_arithmetic_v<Key>)
+            throw std::out_of_range("invalid key: " + std::to_string(key));
+        else
+            throw std::out_of_range("invalid key");
+    }
 
-    return result.node->value;
+    return node->entry.second;
 }
 
-template <class Key, class Value> void Map<Key, Value>::Insert(const Key& key, const Value& value)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Value* Map<Key, Value, Allocator, Augmentation, Stats>::Find(const Key& key)
 {
-    if (m_root == m_sentinel) {
-        m_root = CreateNode(nullptr, key, value, Color::BLACK);
-        m_size++;
-        return;
+    NodePtr node = FindNode(key, MapOperation::LOOKUP);
+
+    return node == m_sentinel ? nullptr : &node->entry.second;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+const Value* Map<Key, Value, Allocator, Augmentation, Stats>::Find(const Key& key) const
+{
+    NodePtr node = FindNode(key, MapOperation::LOOKUP);
+
+    return node == m_sentinel ? nullptr : &node->entry.second;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::Contains(const Key& key) const
+{
+    return FindNode(key, MapOperation::LOOKUP) != m_sentinel;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::TryGet(const Key& key, Value& out) const
+{
+    NodePtr node = FindNode(key, MapOperation::LOOKUP);
+    if (node == m_sentinel)
+        return false;
+
+    out = node->entry.second;
+    return true;
+}
+
+// the keys of a group walk down together, one level per pass, so the child each of them moves to
+// is prefetched while the others are compared and the cache misses overlap instead of queueing
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::LookupBatch(const Key* keys,
+                                                                         const std::size_t count,
+                                                                         Value* out,
+                                                                         bool* found) const
+{
+    std::size_t hits = 0;
+
+    for (std::size_t first = 0; first < count; first += kBatchWidth) {
+        const std::size_t width = std::min(kBatchWidth, count - first);
+
+        // nothing to overlap a lone lookup with, the plain loop has less bookkeeping
+        if (width == 1) {
+            found[first] = TryGet(keys[first], out[first]);
+            hits += found[first];
+            continue;
+        }
+
+        NodePtr nodes[kBatchWidth];
+        std::size_t lengths[kBatchWidth] = {};
+        std::size_t active = width;
+
+        for (std::size_t i = 0; i < width; i++) {
+            nodes[i] = m_root;
+            found[first + i] = false;
+        }
+
+        while (active > 0) {
+            active = 0;
+
+            for (std::size_t i = 0; i < width; i++) {
+                NodePtr node = nodes[i];
+
+                if (node == nullptr)
+                    continue;
+
+                if (node == m_sentinel) {
+                    Stats::Path(MapOperation::LOOKUP, lengths[i]);
+                    nodes[i] = nullptr;
+                    continue;
+                }
+
+                if constexpr (Stats::kEnabled)
+                    lengths[i]++;
+
+                const Key& key = keys[first + i];
+                const bool go_left = m_comparator(key, node->entry.first);
+                const bool go_right = m_comparator(node->entry.first, key);
+                Stats::Count(MapCounter::COMPARISONS, 2);
+
+                if (go_left == go_right) {
+                    Stats::Path(MapOperation::LOOKUP, lengths[i]);
+                    out[first + i] = node->entry.second;
+                    found[first + i] = true;
+                    nodes[i] = nullptr;
+                    hits++;
+                    continue;
+                }
+
+                node = go_left ? node->left : node->right;
+                __builtin_prefetch(node);
+                nodes[i] = node;
+                active++;
+            }
+        }
+    }
+
+    return hits;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::LowerBound(const Key& key)
+{
+    return iterator(LowerBoundNode(key), this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::LowerBound(const Key& key) const
+{
+    return const_iterator(LowerBoundNode(key), this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::UpperBound(const Key& key)
+{
+    return iterator(UpperBoundNode(key), this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::UpperBound(const Key& key) const
+{
+    return const_iterator(UpperBoundNode(key), this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator,
+          typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator>
+Map<Key, Value, Allocator, Augmentation, Stats>::EqualRange(const Key& key)
+{
+    return { LowerBound(key), UpperBound(key) };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator,
+          typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator>
+Map<Key, Value, Allocator, Augmentation, Stats>::EqualRange(const Key& key) const
+{
+    return { LowerBound(key), UpperBound(key) };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Function>
+void Map<Key, Value, Allocator, Augmentation, Stats>::ForEachInRange(const Key& lo, const Key& hi,
+                                                                     Function fn)
+{
+    for (NodePtr node = LowerBoundNode(lo);
+         node != m_sentinel && m_comparator(node->entry.first, hi); node = Successor(node))
+        fn(node->entry.first, node->entry.second);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Function>
+void Map<Key, Value, Allocator, Augmentation, Stats>::ForEachInRange(const Key& lo, const Key& hi,
+                                                                     Function fn) const
+{
+    for (NodePtr node = LowerBoundNode(lo);
+         node != m_sentinel && m_comparator(node->entry.first, hi); node = Successor(node))
+        fn(node->entry.first, static_cast<const Value&>(node->entry.second));
+}
+
+// the number of keys smaller than key, every node passed on the way down to the right is counted
+// together with its left subtree
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::Rank(const Key& key) const
+{
+    static_assert(CountsSubtreeSize<Augmentation>::value,
+                  "Rank() needs an augmentation that counts subtree sizes");
+
+    std::size_t rank = 0;
+    NodePtr node = m_root;
+
+    while (node != m_sentinel) {
+        if (m_comparator(node->entry.first, key)) {
+            rank += SummaryOf(node->left).size + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+
+    return rank;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::Select(const std::size_t index)
+{
+    return iterator(SelectNode(index), this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::Select(const std::size_t index) const
+{
+    return const_iterator(SelectNode(index), this);
+}
+
+// the keys in [lo, hi), like ForEachInRange() would visit them
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::CountRange(const Key& lo,
+                                                                        const Key& hi) const
+{
+    if (!m_comparator(lo, hi))
+        return 0;
+
+    return Rank(hi) - Rank(lo);
+}
+
+// the values of the keys in [lo, hi) folded in key order. Below the first node in range the walk
+// towards lo takes whole right subtrees and the walk towards hi whole left subtrees.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+auto Map<Key, Value, Allocator, Augmentation, Stats>::Aggregate(const Key& lo, const Key& hi) const
+{
+    using Monoid = typename Augmentation::Monoid;
+    using Result = typename Monoid::value_type;
+
+    if (!m_comparator(lo, hi))
+        return Monoid::Identity();
+
+    NodePtr node = m_root;
+
+    while (node != m_sentinel) {
+        if (m_comparator(node->entry.first, lo))
+            node = node->right;
+        else if (!m_comparator(node->entry.first, hi))
+            node = node->left;
+        else
+            break;
+    }
+
+    if (node == m_sentinel)
+        return Monoid::Identity();
+
+    const auto lift = [](const Node* x) { return static_cast<Result>(x->entry.second); };
+
+    Result below = Monoid::Identity();
+    for (NodePtr x = node->left; x != m_sentinel;) {
+        if (m_comparator(x->entry.first, lo)) {
+            x = x->right;
+        } else {
+            below = Monoid::Combine(Monoid::Combine(lift(x), SummaryOf(x->right).aggregate), below);
+            x = x->left;
+        }
+    }
+
+    Result above = Monoid::Identity();
+    for (NodePtr x = node->right; x != m_sentinel;) {
+        if (!m_comparator(x->entry.first, hi)) {
+            x = x->left;
+        } else {
+            above = Monoid::Combine(above, Monoid::Combine(SummaryOf(x->left).aggregate, lift(x)));
+            x = x->right;
+        }
+    }
+
+    return Monoid::Combine(Monoid::Combine(below, lift(node)), above);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::begin()
+{
+    NodePtr node = m_root;
+    while (node != m_sentinel && node->left != m_sentinel)
+        node = node->left;
+
+    return iterator(node, this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::begin() const
+{
+    NodePtr node = m_root;
+    while (node != m_sentinel && node->left != m_sentinel)
+        node = node->left;
+
+    return const_iterator(node, this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::end()
+{
+    return iterator(m_sentinel, this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::end() const
+{
+    return const_iterator(m_sentinel, this);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::reverse_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::rbegin()
+{
+    return reverse_iterator(end());
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_reverse_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::reverse_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::const_reverse_iterator
+Map<Key, Value, Allocator, Augmentation, Stats>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Insert(const Key& key, const Value& value)
+{
+    InsertOrAssign(key, value);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::Insert(NodeHandle&& node)
+{
+    if (node.Empty())
+        return { end(), false };
+
+    SearchResult result = Search(node.m_node->entry.first, MapOperation::INSERT);
+    if (result.node != m_sentinel)
+        return { iterator(result.node, this), false };
+
+    NodePtr new_node = node.m_node;
+    if (m_pool.Attach(new_node, node.m_share)) {
+        // our pool can free the node, it is linked in as it is without allocating or constructing
+        new_node->parent_color = Link(nullptr, Color::RED);
+        new_node->left = m_sentinel;
+        new_node->right = m_sentinel;
+        node.m_node = nullptr;
+    } else {
+        // allocators that cannot free each other's memory, the entry moves into a node of ours
+        new_node = CreateNode(nullptr, Color::RED, node.m_node->entry.first,
+                              std::move(node.m_node->entry.second));
+        node.Reset();
+    }
+
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class... Args>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::Emplace(Args&&... args)
+{
+    // the key is only known once the entry exists, a duplicate goes straight back to the pool
+    NodePtr new_node = CreateNode(nullptr, Color::RED, std::forward<Args>(args)...);
+
+    SearchResult result = Search(new_node->entry.first, MapOperation::INSERT);
+    if (result.node != m_sentinel) {
+        m_pool.Destroy(new_node);
+        return { iterator(result.node, this), false };
+    }
+
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class... Args>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::TryEmplace(const Key& key, Args&&... args)
+{
+    SearchResult result = Search(key, MapOperation::INSERT);
+    if (result.node != m_sentinel)
+        return { iterator(result.node, this), false };
+
+    NodePtr new_node = CreateNode(nullptr, Color::RED, std::piecewise_construct,
+                                  std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class... Args>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::TryEmplace(Key&& key, Args&&... args)
+{
+    SearchResult result = Search(key, MapOperation::INSERT);
+    if (result.node != m_sentinel)
+        return { iterator(result.node, this), false };
+
+    NodePtr new_node = CreateNode(nullptr, Color::RED, std::piecewise_construct,
+                                  std::forward_as_tuple(std::move(key)),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class M>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::InsertOrAssign(const Key& key, M&& value)
+{
+    SearchResult result = Search(key, MapOperation::INSERT);
+    if (result.node != m_sentinel) {
+        result.node->entry.second = std::forward<M>(value);
+        // the shape stays, only the summaries that fold values on the path change
+        RefreshPath(result.node);
+        return { iterator(result.node, this), false };
     }
 
-    SearchResult result = Search(key, m_root, nullptr);
+    NodePtr new_node = CreateNode(nullptr, Color::RED, key, std::forward<M>(value));
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class M>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::iterator, bool>
+Map<Key, Value, Allocator, Augmentation, Stats>::InsertOrAssign(Key&& key, M&& value)
+{
+    SearchResult result = Search(key, MapOperation::INSERT);
     if (result.node != m_sentinel) {
-        result.node->value = value;
+        result.node->entry.second = std::forward<M>(value);
+        RefreshPath(result.node);
+        return { iterator(result.node, this), false };
+    }
+
+    NodePtr new_node = CreateNode(nullptr, Color::RED, std::move(key), std::forward<M>(value));
+    Attach(new_node, result.parent);
+
+    return { iterator(new_node, this), true };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle
+Map<Key, Value, Allocator, Augmentation, Stats>::Extract(const Key& key)
+{
+    NodePtr node = FindNode(key, MapOperation::REMOVE);
+    if (node == m_sentinel)
+        return NodeHandle();
+
+    // the node leaves the tree as it is, nothing is copied or moved out of it
+    Unlink(node);
+
+    return NodeHandle(node, m_pool.Detach(node));
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Attach(NodePtr new_node, NodePtr parent)
+{
+    m_size++;
+
+    if (parent == nullptr) {
+        m_root = new_node;
+        SetColor(m_root, Color::BLACK);
+        Refresh(new_node);
         return;
     }
 
-    NodePtr new_node = CreateNode(nullptr, key, value);
-    new_node->parent = result.parent;
-    if (m_comparator(key, new_node->parent->key)) {
-        new_node->parent->left = new_node;
+    SetParent(new_node, parent);
+    if (m_comparator(new_node->entry.first, Parent(new_node)->entry.first)) {
+        Parent(new_node)->left = new_node;
     } else {
-        new_node->parent->right = new_node;
+        Parent(new_node)->right = new_node;
     }
-    m_size++;
 
-    if (new_node->parent == nullptr || new_node->parent->parent == nullptr)
+    // every subtree on the way up gained new_node, the rotations below keep that up to date
+    RefreshPath(new_node);
+
+    if (Parent(new_node) == nullptr || Parent(Parent(new_node)) == nullptr)
         return;
 
     NodePtr uncle_node;
-    while (new_node->parent != nullptr && new_node->parent->color == Color::RED) {
-        if (RightChild(new_node->parent)) {
-            uncle_node = new_node->parent->parent->left;
-            if (uncle_node->color == Color::BLACK) {
+    while (Parent(new_node) != nullptr && GetColor(Parent(new_node)) == Color::RED) {
+        Stats::Count(MapCounter::INSERT_FIXUPS);
+
+        if (RightChild(Parent(new_node))) {
+            uncle_node = Parent(Parent(new_node))->left;
+            if (GetColor(uncle_node) == Color::BLACK) {
                 if (LeftChild(new_node)) {
-                    new_node = new_node->parent;
+                    new_node = Parent(new_node);
                     RightRotate(new_node);
                 }
 
-                new_node->parent->color = Color::BLACK;
-                new_node->parent->parent->color = Color::RED;
-                LeftRotate(new_node->parent->parent);
+                SetColor(Parent(new_node), Color::BLACK);
+                SetColor(Parent(Parent(new_node)), Color::RED);
+                LeftRotate(Parent(Parent(new_node)));
             } else {
                 Recolor(new_node, uncle_node);
-                new_node = new_node->parent->parent;
+                new_node = Parent(Parent(new_node));
             }
         } else {
-            uncle_node = new_node->parent->parent->right;
-            if (uncle_node->color == Color::BLACK) {
+            uncle_node = Parent(Parent(new_node))->right;
+            if (GetColor(uncle_node) == Color::BLACK) {
                 if (RightChild(new_node)) {
-                    new_node = new_node->parent;
+                    new_node = Parent(new_node);
                     LeftRotate(new_node);
                 }
 
-                new_node->parent->color = Color::BLACK;
-                new_node->parent->parent->color = Color::RED;
-                RightRotate(new_node->parent->parent);
+                SetColor(Parent(new_node), Color::BLACK);
+                SetColor(Parent(Parent(new_node)), Color::RED);
+                RightRotate(Parent(Parent(new_node)));
             } else {
                 Recolor(new_node, uncle_node);
-                new_node = new_node->parent->parent;
+                new_node = Parent(Parent(new_node));
             }
         }
     }
 
-    m_root->color = Color::BLACK;
+    SetColor(m_root, Color::BLACK);
 }
 
-template <class Key, class Value> void Map<Key, Value>::Remove(const Key& key)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Remove(const Key& key)
 {
-    SearchResult result = Search(key, m_root, nullptr);
+    SearchResult result = Search(key, MapOperation::REMOVE);
     if (result.node == m_sentinel)
         return;
 
-    NodePtr node_to_be_fixed = result.node;
-    Color original_color = result.node->color;
+    RemoveNode(result.node);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::RemoveNode(NodePtr node)
+{
+    Unlink(node);
+    m_pool.Destroy(node);
+}
 
-    if (LeafNode(result.node) || HasOnlyRightChild(result.node)) {
-        node_to_be_fixed = result.node->right;
-        Transplant(result.node, result.node->right);
-    } else if (HasOnlyLeftChild(result.node)) {
-        node_to_be_fixed = result.node->left;
-        Transplant(result.node, result.node->left);
+// takes node out of the tree and rebalances, the node itself is left alone
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Unlink(NodePtr node)
+{
+    NodePtr node_to_be_fixed = node;
+    Color original_color = GetColor(node);
+
+    if (LeafNode(node) || HasOnlyRightChild(node)) {
+        node_to_be_fixed = node->right;
+        Transplant(node, node->right);
+    } else if (HasOnlyLeftChild(node)) {
+        node_to_be_fixed = node->left;
+        Transplant(node, node->left);
     } else {
-        NodePtr right_min = result.node->right;
+        NodePtr right_min = node->right;
         while (right_min->left != m_sentinel) {
             right_min = right_min->left;
         }
 
-        original_color = right_min->color;
+        original_color = GetColor(right_min);
         node_to_be_fixed = right_min->right;
 
-        if (right_min->parent == result.node) {
-            node_to_be_fixed->parent = right_min;
+        if (Parent(right_min) == node) {
+            SetParent(node_to_be_fixed, right_min);
         } else {
             Transplant(right_min, right_min->right);
-            right_min->right = result.node->right;
-            right_min->right->parent = right_min;
+            right_min->right = node->right;
+            SetParent(right_min->right, right_min);
         }
 
-        Transplant(result.node, right_min);
-        right_min->left = result.node->left;
-        right_min->left->parent = right_min;
-        right_min->color = result.node->color;
+        Transplant(node, right_min);
+        right_min->left = node->left;
+        SetParent(right_min->left, right_min);
+        SetColor(right_min, GetColor(node));
     }
 
+    // the subtrees that lost a node are the ones above the place node_to_be_fixed moved into
+    RefreshPath(Parent(node_to_be_fixed));
+
     if (original_color == Color::BLACK) {
         if (node_to_be_fixed) {
             NodePtr x = node_to_be_fixed;
             NodePtr s;
-            while (x != m_root && x->color == Color::BLACK) {
+            while (x != m_root && GetColor(x) == Color::BLACK) {
+                Stats::Count(MapCounter::REMOVE_FIXUPS);
+
                 if (LeftChild(x)) {
-                    s = x->parent->right;
+                    s = Parent(x)->right;
 
-                    if (s->color == Color::RED) {
-                        s->color = Color::BLACK;
-                        x->parent->color = Color::RED;
-                        LeftRotate(x->parent);
-                        s = x->parent->right;
+                    if (GetColor(s) == Color::RED) {
+                        SetColor(s, Color::BLACK);
+                        SetColor(Parent(x), Color::RED);
+                        LeftRotate(Parent(x));
+                        s = Parent(x)->right;
                     }
 
-                    if (s->left && s->left->color == Color::BLACK && s->right
-                        && s->right->color == Color::BLACK) {
-                        s->color = Color::RED;
-                        x = x->parent;
+                    if (s->left && GetColor(s->left) == Color::BLACK && s->right
+                        && GetColor(s->right) == Color::BLACK) {
+                        SetColor(s, Color::RED);
+                        x = Parent(x);
                     } else {
-                        if (s->right && s->right->color == Color::BLACK) {
+                        if (s->right && GetColor(s->right) == Color::BLACK) {
                             if (s->left)
-                                s->left->color = Color::BLACK;
-                            s->color = Color::RED;
+                                SetColor(s->left, Color::BLACK);
+                            SetColor(s, Color::RED);
                             RightRotate(s);
-                            s = x->parent->right;
+                            s = Parent(x)->right;
                         }
 
-                        s->color = x->parent->color;
-                        x->parent->color = Color::BLACK;
+                        SetColor(s, GetColor(Parent(x)));
+                        SetColor(Parent(x), Color::BLACK);
                         if (s->right)
-                            s->right->color = Color::BLACK;
-                        LeftRotate(x->parent);
+                            SetColor(s->right, Color::BLACK);
+                        LeftRotate(Parent(x));
                         x = m_root;
                     }
                 } else {
-                    s = x->parent->left;
-                    if (s->color == Color::RED) {
-                        s->color = Color::BLACK;
-                        x->parent->color = Color::RED;
-                        RightRotate(x->parent);
-                        s = x->parent->left;
+                    s = Parent(x)->left;
+                    if (GetColor(s) == Color::RED) {
+                        SetColor(s, Color::BLACK);
+                        SetColor(Parent(x), Color::RED);
+                        RightRotate(Parent(x));
+                        s = Parent(x)->left;
                     }
 
-                    if (s->left && s->left->color == Color::BLACK && s->right
-                        && s->right->color == Color::BLACK) {
-                        s->color = Color::RED;
-                        x = x->parent;
+                    if (s->left && GetColor(s->left) == Color::BLACK && s->right
+                        && GetColor(s->right) == Color::BLACK) {
+                        SetColor(s, Color::RED);
+                        x = Parent(x);
                     } else {
-                        if (s->left && s->left->color == Color::BLACK) {
+                        if (s->left && GetColor(s->left) == Color::BLACK) {
                             if (s->right)
-                                s->right->color = Color::BLACK;
-                            s->color = Color::RED;
+                                SetColor(s->right, Color::BLACK);
+                            SetColor(s, Color::RED);
                             LeftRotate(s);
-                            s = x->parent->left;
+                            s = Parent(x)->left;
                         }
 
-                        s->color = x->parent->color;
-                        x->parent->color = Color::BLACK;
+                        SetColor(s, GetColor(Parent(x)));
+                        SetColor(Parent(x), Color::BLACK);
                         if (s->left)
-                            s->left->color = Color::BLACK;
-                        RightRotate(x->parent);
+                            SetColor(s->left, Color::BLACK);
+                        RightRotate(Parent(x));
                         x = m_root;
                     }
                 }
             }
-            m_sentinel->parent = nullptr;
-            x->color = Color::BLACK;
+            SetParent(m_sentinel, nullptr);
+            SetColor(x, Color::BLACK);
         }
     }
 
-    delete result.node;
     m_size--;
 }
 
-template <class Key, class Value> std::size_t Map<Key, Value>::Size() const { return m_size; }
-
-template <class Key, class Value>
-std::size_t Map<Key, Value>::MaxDepth(NodePtr root, const bool first_node)
-{
-    if (first_node)
-        root = m_root;
-
-    if (root == m_sentinel || LeafNode(root))
-        return 0;
-    else {
-        auto left_depth = MaxDepth(root->left, false);
-        auto right_depth = MaxDepth(root->right, false);
-
-        if (left_depth > right_depth)
-            return (left_depth + 1);
-        else
-            return (right_depth + 1);
-    }
-}
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::Size() const { return m_size; }
 
-template <class Key, class Value>
-typename Map<Key, Value>::NodePtr Map<Key, Value>::CreateNode(ConstNodePtr parent, const Key& key,
-                                                              const Value& value, ConstColor color)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Reserve(const std::size_t n)
 {
-    NodePtr node = new Node { key, value, parent, m_sentinel, m_sentinel, color };
-
-    return node;
+    m_pool.Reserve(n);
 }
 
-template <class Key, class Value>
-typename Map<Key, Value>::SearchResult Map<Key, Value>::Search(const Key& key, ConstNodePtr root,
-                                                               ConstNodePtr parent)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Clear()
 {
-    if (root == m_sentinel || (key == root->key))
-        return { root, parent };
+    if (m_sentinel == nullptr)
+        return;
 
-    if (m_comparator(key, root->key))
-        return Search(key, root->left, root);
-    else
-        return Search(key, root->right, root);
+    DeleteTree(m_root);
+    m_pool.Release();
+    m_root = m_sentinel;
+    SetParent(m_sentinel, nullptr);
+    m_size = 0;
 }
 
-template <class Key, class Value> void Map<Key, Value>::LeftRotate(ConstNodePtr x)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+void Map<Key, Value, Allocator, Augmentation, Stats>::BuildFromSorted(ForwardIt first,
+                                                                      ForwardIt last,
+                                                                      const SortedMode mode)
 {
-    ConstNodePtr y = x->right;
-
-    x->right = y->left;
-    if (y->left != m_sentinel) {
-        y->left->parent = x;
-    }
-
-    y->parent = x->parent;
-    if (x->parent == nullptr) {
-        m_root = y;
-    } else if (x == x->parent->left) {
-        x->parent->left = y;
+    if (mode == SortedMode::VERIFY) {
+        if (!StrictlyIncreasing(first, last))
+            throw std::invalid_argument("keys are not strictly increasing");
     } else {
-        x->parent->right = y;
+        assert(StrictlyIncreasing(first, last));
     }
 
-    y->left = x;
-    x->parent = y;
+    Clear();
+
+    const std::size_t n = static_cast<std::size_t>(std::distance(first, last));
+    if (n == 0)
+        return;
+
+    Reserve(n);
+    m_root = BuildSubtree(first, n, 0, RedDepth(n), m_pool);
+    SetParent(m_root, nullptr);
+    m_size = n;
 }
 
-template <class Key, class Value> void Map<Key, Value>::RightRotate(ConstNodePtr x)
+// the entries are sorted by `threads` threads, then the subtrees are built concurrently, each
+// thread allocating from a pool of its own that m_pool adopts at the end. Like a run of Insert()
+// calls the last entry given for a key wins. If building throws the map is left empty.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class InputIt>
+void Map<Key, Value, Allocator, Augmentation, Stats>::BuildParallel(InputIt first, InputIt last,
+                                                                    const std::size_t threads)
 {
-    ConstNodePtr y = x->left;
+    const std::size_t workers = std::max<std::size_t>(threads, 1);
 
-    x->left = y->right;
-    if (y->right != m_sentinel) {
-        y->right->parent = x;
-    }
+    Entries entries(first, last);
+    SortByKey(entries, workers);
 
-    y->parent = x->parent;
-    if (x->parent == nullptr) {
-        m_root = y;
-    } else if (x == x->parent->right) {
-        x->parent->right = y;
-    } else {
-        x->parent->left = y;
+    auto out = entries.begin();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        const auto next = std::next(it);
+        if (next != entries.end() && !m_comparator(it->first, next->first))
+            continue;
+
+        if (out != it)
+            *out = std::move(*it);
+        ++out;
     }
+    entries.erase(out, entries.end());
 
-    y->right = x;
-    x->parent = y;
-}
+    Clear();
 
-template <class Key, class Value>
-void Map<Key, Value>::Recolor(NodePtr new_node, NodePtr uncle_node)
-{
-    if (new_node == nullptr || uncle_node == nullptr)
+    const std::size_t n = entries.size();
+    if (n == 0)
         return;
 
-    NodePtr parent_node = new_node->parent;
-    if (parent_node == nullptr)
-        return;
+    std::vector<Pool> pools;
+    pools.reserve(workers);
+    for (std::size_t i = 0; i < workers; i++)
+        pools.emplace_back(m_pool.GetAllocator());
 
-    NodePtr grandparent_node = parent_node->parent;
-    uncle_node->color = Color::BLACK;
-    parent_node->color = Color::BLACK;
-    if (grandparent_node != nullptr && grandparent_node != m_root)
-        grandparent_node->color = Color::RED;
-}
+    m_root = BuildSubtreeParallel(std::make_move_iterator(entries.begin()), n, 0, RedDepth(n),
+                                  pools.data(), workers);
+    SetParent(m_root, nullptr);
+    m_size = n;
 
-template <class Key, class Value> inline bool Map<Key, Value>::LeafNode(ConstNodePtr node)
-{
-    return (node->left == m_sentinel && node->right == m_sentinel);
+    for (Pool& pool : pools)
+        m_pool.Adopt(std::move(pool));
 }
 
-template <class Key, class Value> inline bool Map<Key, Value>::HasOnlyLeftChild(ConstNodePtr node)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::ApplyBatch(std::vector<BatchOp> ops)
 {
-    return (node->left != m_sentinel && node->right == m_sentinel);
-}
+    // stable, so that of several updates to one key the last one given still wins
+    std::stable_sort(ops.begin(), ops.end(), [this](const BatchOp& lhs, const BatchOp& rhs) {
+        return m_comparator(lhs.key, rhs.key);
+    });
 
-template <class Key, class Value> inline bool Map<Key, Value>::HasOnlyRightChild(ConstNodePtr node)
-{
-    return (node->left == m_sentinel && node->right != m_sentinel);
+    ApplySortedBatch(std::make_move_iterator(ops.begin()), std::make_move_iterator(ops.end()),
+                     SortedMode::ASSUME);
 }
 
-template <class Key, class Value> inline bool Map<Key, Value>::HasTwoChildren(ConstNodePtr node)
+// a batch that is a sizeable part of the tree is merged with it and the tree rebuilt in
+// O(n + m), a small one is applied in a single sweep from left to right
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+void Map<Key, Value, Allocator, Augmentation, Stats>::ApplySortedBatch(ForwardIt first,
+                                                                       ForwardIt last,
+                                                                       const SortedMode mode)
 {
-    return (node->left != m_sentinel && node->right != m_sentinel);
-}
+    if (mode == SortedMode::VERIFY) {
+        if (!SortedByKey(first, last))
+            throw std::invalid_argument("batch is not sorted by key");
+    } else {
+        assert(SortedByKey(first, last));
+    }
 
-template <class Key, class Value> inline bool Map<Key, Value>::LeftChild(ConstNodePtr node)
-{
-    return (node->parent != nullptr && node->parent->left == node);
-}
+    const std::size_t n = static_cast<std::size_t>(std::distance(first, last));
+    if (n == 0)
+        return;
 
-template <class Key, class Value> inline bool Map<Key, Value>::RightChild(ConstNodePtr node)
-{
-    return (node->parent != nullptr && node->parent->right == node);
+    if (n * kDenseBatchRatio >= m_size)
+        MergeAndRebuild(first, last);
+    else
+        ApplySweep(first, last);
 }
 
-template <class Key, class Value> inline void Map<Key, Value>::Transplant(NodePtr x, NodePtr y)
+// the set operations are join based: they walk the tree of other and split ours at its keys, so
+// they cost O(m log(n / m + 1)) for maps of sizes m <= n, and the two halves left after each split
+// are independent and may go to different threads. merge may be called from several threads at
+// once and must not throw.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Merge>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Union(Map&& other, Merge merge,
+                                                            const std::size_t threads)
 {
-    if (x == nullptr)
+    if (this == &other || other.m_sentinel == nullptr || other.m_size == 0)
         return;
 
-    if (x->parent == nullptr) {
+    // the leaves of the adopted tree have to point at our sentinel, to walk only the smaller
+    // tree for that the two maps swap places first when other is larger
+    const bool swapped = other.m_size > m_size;
+    if (swapped)
+        Swap(other);
+
+    const std::size_t size = m_size + other.m_size;
+    const Tree theirs = AdoptTree(other);
+
+    std::vector<NodePtr> dropped;
+    const Tree tree = UnionTrees({ m_root, BlackHeight(m_root) }, theirs, merge, swapped,
+                                 Workers(threads, size), dropped);
+
+    SetRoot(tree.root);
+    m_size = size - ReleaseNodes(dropped);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Merge>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Intersection(const Map& other, Merge merge,
+                                                                   const std::size_t threads)
+{
+    // our tree is split while the one of other is walked, they cannot be the same
+    if (this == &other) {
+        const Map copy(other);
+        Intersection(copy, merge, threads);
+        return;
+    }
+
+    if (other.m_sentinel == nullptr || other.m_size == 0) {
+        Clear();
+        return;
+    }
+
+    std::vector<NodePtr> dropped;
+    const Tree tree = IntersectTrees({ m_root, BlackHeight(m_root) }, other.m_root, other, merge,
+                                     Workers(threads, m_size + other.m_size), dropped);
+
+    SetRoot(tree.root);
+    m_size -= ReleaseNodes(dropped);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Difference(const Map& other,
+                                                                 const std::size_t threads)
+{
+    if (this == &other) {
+        Clear();
+        return;
+    }
+
+    if (other.m_sentinel == nullptr || other.m_size == 0)
+        return;
+
+    std::vector<NodePtr> dropped;
+    const Tree tree = DifferenceTrees({ m_root, BlackHeight(m_root) }, other.m_root, other,
+                                      Workers(threads, m_size + other.m_size), dropped);
+
+    SetRoot(tree.root);
+    m_size -= ReleaseNodes(dropped);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+constexpr std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::NodeBytes()
+{
+    return sizeof(Node);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::MemoryUsage() const
+{
+    std::size_t bytes = sizeof(*this) + m_pool.MemoryUsage();
+    if (m_sentinel != nullptr)
+        bytes += sizeof(Node);
+
+    return bytes;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+FrozenMap<Key, Value> Map<Key, Value, Allocator, Augmentation, Stats>::Freeze() const
+{
+    return FrozenMap<Key, Value>(begin(), m_size);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::MaxDepth(NodePtr root,
+                                                                      const bool first_node)
+{
+    if (first_node)
+        root = m_root;
+
+    if (root == m_sentinel || LeafNode(root))
+        return 0;
+    else {
+        auto left_depth = MaxDepth(root->left, false);
+        auto right_depth = MaxDepth(root->right, false);
+
+        if (left_depth > right_depth)
+            return (left_depth + 1);
+        else
+            return (right_depth + 1);
+    }
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class... Args>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::CreateNode(ConstNodePtr parent, ConstColor color,
+                                                            Args&&... args)
+{
+    NodePtr node = m_pool.Create(Link(parent, color), m_sentinel, m_sentinel,
+                                 std::forward<Args>(args)...);
+    Stats::Count(MapCounter::ALLOCATIONS);
+
+    return node;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::SearchResult
+Map<Key, Value, Allocator, Augmentation, Stats>::Search(const Key& key,
+                                                        const MapOperation operation,
+                                                        NodePtr finger) const
+{
+    NodePtr node = m_root;
+    NodePtr parent = nullptr;
+    std::size_t length = 0;
+    std::size_t climbed = 0;
+    std::size_t compared = 0;
+
+    // a finger is a node with a smaller key. The search climbs from it without comparing past the
+    // ancestors it is the right of, the first one it is the left of ends the climb if its key is
+    // larger and otherwise becomes the finger. The descent then starts at the finger.
+    if (finger != nullptr && finger != m_sentinel) {
+        node = finger;
+        for (NodePtr up = finger; up != m_root; up = parent) {
+            if constexpr (Stats::kEnabled)
+                climbed++;
+
+            parent = Parent(up);
+            if (up == parent->left) {
+                if constexpr (Stats::kEnabled)
+                    compared++;
+
+                if (m_comparator(key, parent->entry.first))
+                    break;
+
+                node = parent;
+            }
+        }
+
+        parent = Parent(node);
+    }
+
+    while (node != m_sentinel) {
+        if constexpr (Stats::kEnabled)
+            length++;
+
+        const bool go_left = m_comparator(key, node->entry.first);
+        const bool go_right = m_comparator(node->entry.first, key);
+        if (go_left == go_right)
+            break;
+
+        parent = node;
+        node = go_left ? node->left : node->right;
+    }
+
+    Stats::Count(MapCounter::COMPARISONS, compared + 2 * length);
+    Stats::Path(operation, climbed + length);
+
+    return { node, parent };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::FindNode(const Key& key,
+                                                          const MapOperation operation) const
+{
+    NodePtr node = m_root;
+    std::size_t length = 0;
+
+    // the only branch is the exit on a match, picking the child compiles to a conditional move
+    while (node != m_sentinel) {
+        if constexpr (Stats::kEnabled)
+            length++;
+
+        const bool go_left = m_comparator(key, node->entry.first);
+        const bool go_right = m_comparator(node->entry.first, key);
+        if (go_left == go_right)
+            break;
+
+        node = go_left ? node->left : node->right;
+    }
+
+    Stats::Count(MapCounter::COMPARISONS, 2 * length);
+    Stats::Path(operation, length);
+
+    return node;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::LowerBoundNode(const Key& key) const
+{
+    NodePtr node = m_root;
+    NodePtr bound = m_sentinel;
+
+    while (node != m_sentinel) {
+        if (m_comparator(node->entry.first, key)) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+
+    return bound;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::UpperBoundNode(const Key& key) const
+{
+    NodePtr node = m_root;
+    NodePtr bound = m_sentinel;
+
+    while (node != m_sentinel) {
+        if (m_comparator(key, node->entry.first)) {
+            bound = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return bound;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::Successor(NodePtr node) const
+{
+    if (node->right != m_sentinel) {
+        node = node->right;
+        while (node->left != m_sentinel)
+            node = node->left;
+
+        return node;
+    }
+
+    NodePtr parent = Parent(node);
+    while (parent != nullptr && node == parent->right) {
+        node = parent;
+        parent = Parent(parent);
+    }
+
+    return parent == nullptr ? m_sentinel : parent;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::Predecessor(NodePtr node) const
+{
+    // stepping back from end() lands on the largest key
+    if (node == m_sentinel) {
+        node = m_root;
+        while (node != m_sentinel && node->right != m_sentinel)
+            node = node->right;
+
+        return node;
+    }
+
+    if (node->left != m_sentinel) {
+        node = node->left;
+        while (node->right != m_sentinel)
+            node = node->right;
+
+        return node;
+    }
+
+    NodePtr parent = Parent(node);
+    while (parent != nullptr && node == parent->left) {
+        node = parent;
+        parent = Parent(parent);
+    }
+
+    return parent == nullptr ? m_sentinel : parent;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::LeftRotate(ConstNodePtr x)
+{
+    ConstNodePtr y = x->right;
+
+    x->right = y->left;
+    if (y->left != m_sentinel) {
+        SetParent(y->left, x);
+    }
+
+    SetParent(y, Parent(x));
+    if (Parent(x) == nullptr) {
+        m_root = y;
+    } else if (x == Parent(x)->left) {
+        Parent(x)->left = y;
+    } else {
+        Parent(x)->right = y;
+    }
+
+    y->left = x;
+    SetParent(x, y);
+
+    Refresh(x);
+    Refresh(y);
+    Stats::Count(MapCounter::ROTATIONS);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::RightRotate(ConstNodePtr x)
+{
+    ConstNodePtr y = x->left;
+
+    x->left = y->right;
+    if (y->right != m_sentinel) {
+        SetParent(y->right, x);
+    }
+
+    SetParent(y, Parent(x));
+    if (Parent(x) == nullptr) {
+        m_root = y;
+    } else if (x == Parent(x)->right) {
+        Parent(x)->right = y;
+    } else {
+        Parent(x)->left = y;
+    }
+
+    y->right = x;
+    SetParent(x, y);
+
+    Refresh(x);
+    Refresh(y);
+    Stats::Count(MapCounter::ROTATIONS);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Recolor(NodePtr new_node, NodePtr uncle_node)
+{
+    if (new_node == nullptr || uncle_node == nullptr)
+        return;
+
+    NodePtr parent_node = Parent(new_node);
+    if (parent_node == nullptr)
+        return;
+
+    NodePtr grandparent_node = Parent(parent_node);
+    Stats::Count(MapCounter::RECOLORS);
+    SetColor(uncle_node, Color::BLACK);
+    SetColor(parent_node, Color::BLACK);
+    if (grandparent_node != nullptr && grandparent_node != m_root)
+        SetColor(grandparent_node, Color::RED);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline std::uintptr_t Map<Key, Value, Allocator, Augmentation, Stats>::Link(ConstNodePtr parent,
+                                                                            ConstColor color)
+{
+    return reinterpret_cast<std::uintptr_t>(parent) | static_cast<std::uintptr_t>(color);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::Parent(const Node* node)
+{
+    return reinterpret_cast<NodePtr>(node->parent_color & ~kColorMask);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline void Map<Key, Value, Allocator, Augmentation, Stats>::SetParent(ConstNodePtr node,
+                                                                       ConstNodePtr parent)
+{
+    node->parent_color = Link(parent, GetColor(node));
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline Color Map<Key, Value, Allocator, Augmentation, Stats>::GetColor(const Node* node)
+{
+    return static_cast<Color>(node->parent_color & kColorMask);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline void Map<Key, Value, Allocator, Augmentation, Stats>::SetColor(ConstNodePtr node,
+                                                                      ConstColor color)
+{
+    node->parent_color = (node->parent_color & ~kColorMask) | static_cast<std::uintptr_t>(color);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::LeafNode(ConstNodePtr node)
+{
+    return (node->left == m_sentinel && node->right == m_sentinel);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::HasOnlyLeftChild(ConstNodePtr node)
+{
+    return (node->left != m_sentinel && node->right == m_sentinel);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::HasOnlyRightChild(ConstNodePtr node)
+{
+    return (node->left == m_sentinel && node->right != m_sentinel);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::HasTwoChildren(ConstNodePtr node)
+{
+    return (node->left != m_sentinel && node->right != m_sentinel);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::LeftChild(ConstNodePtr node)
+{
+    return (Parent(node) != nullptr && Parent(node)->left == node);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline bool Map<Key, Value, Allocator, Augmentation, Stats>::RightChild(ConstNodePtr node)
+{
+    return (Parent(node) != nullptr && Parent(node)->right == node);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline void Map<Key, Value, Allocator, Augmentation, Stats>::Transplant(NodePtr x, NodePtr y)
+{
+    if (x == nullptr)
+        return;
+
+    if (Parent(x) == nullptr) {
         m_root = y;
     } else if (LeftChild(x)) {
-        x->parent->left = y;
+        Parent(x)->left = y;
+    } else {
+        Parent(x)->right = y;
+    }
+
+    if (y != nullptr)
+        SetParent(y, Parent(x));
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::Sibling(ConstNodePtr node)
+{
+    if (Parent(node)) {
+        if (LeftChild(node)) {
+            return Parent(node)->right;
+        } else {
+            return Parent(node)->left;
+        }
     } else {
-        x->parent->right = y;
+        return nullptr;
+    }
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::DeleteTree(NodePtr node)
+{
+    // the memory itself goes back with the slabs, only non-trivial destructors need a walk
+    if constexpr (std::is_trivially_destructible_v<Node>)
+        return;
+
+    // right rotations flatten the tree into a list so that no stack is needed
+    while (node != m_sentinel && node != nullptr) {
+        if (node->left != m_sentinel) {
+            NodePtr left = node->left;
+            node->left = left->right;
+            left->right = node;
+            node = left;
+        } else {
+            NodePtr right = node->right;
+            node->~Node();
+            node = right;
+        }
+    }
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::CopyTree(const Map& other)
+{
+    if (other.m_root == other.m_sentinel)
+        return;
+
+    Reserve(other.m_size);
+
+    // the other tree is already balanced, so its shape and colors are cloned node for node in
+    // pre-order, parent pointers lead back up so no stack is needed
+    NodePtr source = other.m_root;
+    m_root = CreateNode(nullptr, GetColor(source), source->entry);
+    NodePtr target = m_root;
+    SummaryOf(target) = SummaryOf(source);
+
+    while (true) {
+        if (source->left != other.m_sentinel && target->left == m_sentinel) {
+            source = source->left;
+            target->left = CreateNode(target, GetColor(source), source->entry);
+            target = target->left;
+            SummaryOf(target) = SummaryOf(source);
+        } else if (source->right != other.m_sentinel && target->right == m_sentinel) {
+            source = source->right;
+            target->right = CreateNode(target, GetColor(source), source->entry);
+            target = target->right;
+            SummaryOf(target) = SummaryOf(source);
+        } else if (source != other.m_root) {
+            source = Parent(source);
+            target = Parent(target);
+        } else {
+            break;
+        }
+    }
+
+    m_size = other.m_size;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+bool
+Map<Key, Value, Allocator, Augmentation, Stats>::StrictlyIncreasing(ForwardIt first,
+                                                                    ForwardIt last) const
+{
+    if (first == last)
+        return true;
+
+    for (ForwardIt next = std::next(first); next != last; first = next, ++next) {
+        if (!m_comparator(first->first, next->first))
+            return false;
+    }
+
+    return true;
+}
+
+// unlike StrictlyIncreasing() equal keys are fine, the last update of a key wins
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::SortedByKey(ForwardIt first,
+                                                                  ForwardIt last) const
+{
+    if (first == last)
+        return true;
+
+    for (ForwardIt next = std::next(first); next != last; first = next, ++next) {
+        if (m_comparator(next->key, first->key))
+            return false;
+    }
+
+    return true;
+}
+
+// each search starts at the node of the previous update, whose key is smaller, and climbs only
+// as far as the subtree that holds the next key instead of descending from the root again, so
+// updates that lie close together compare against little more than the nodes between them
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+void Map<Key, Value, Allocator, Augmentation, Stats>::ApplySweep(ForwardIt first, ForwardIt last)
+{
+    NodePtr finger = m_sentinel;
+
+    for (ForwardIt next = first; first != last; first = next) {
+        ++next;
+
+        // only the last of several updates to one key matters
+        if (next != last && !m_comparator(first->key, next->key))
+            continue;
+
+        auto&& op = *first;
+        const MapOperation operation = op.value ? MapOperation::INSERT : MapOperation::REMOVE;
+        SearchResult result = Search(op.key, operation, finger);
+
+        if (op.value) {
+            if (result.node != m_sentinel) {
+                result.node->entry.second = *std::forward<decltype(op)>(op).value;
+                RefreshPath(result.node);
+                finger = result.node;
+            } else {
+                finger = CreateNode(nullptr, Color::RED, op.key,
+                                    *std::forward<decltype(op)>(op).value);
+                Attach(finger, result.parent);
+            }
+        } else if (result.node != m_sentinel) {
+            // the predecessor is not moved by the removal and its key is still smaller
+            finger = Predecessor(result.node);
+            RemoveNode(result.node);
+        }
+    }
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+void Map<Key, Value, Allocator, Augmentation, Stats>::MergeAndRebuild(ForwardIt first,
+                                                                      ForwardIt last)
+{
+    std::vector<std::pair<Key, Value>> merged;
+    merged.reserve(m_size + static_cast<std::size_t>(std::distance(first, last)));
+
+    // the old values are moved out, the tree is rebuilt from merged right after
+    NodePtr node = begin().m_node;
+
+    for (ForwardIt next = first; first != last; first = next) {
+        ++next;
+
+        if (next != last && !m_comparator(first->key, next->key))
+            continue;
+
+        auto&& op = *first;
+
+        while (node != m_sentinel && m_comparator(node->entry.first, op.key)) {
+            merged.emplace_back(node->entry.first, std::move(node->entry.second));
+            node = Successor(node);
+        }
+
+        // the update replaces or drops an entry with the same key
+        if (node != m_sentinel && !m_comparator(op.key, node->entry.first))
+            node = Successor(node);
+
+        if (op.value)
+            merged.emplace_back(op.key, *std::forward<decltype(op)>(op).value);
+    }
+
+    for (; node != m_sentinel; node = Successor(node))
+        merged.emplace_back(node->entry.first, std::move(node->entry.second));
+
+    BuildFromSorted(std::make_move_iterator(merged.begin()),
+                    std::make_move_iterator(merged.end()), SortedMode::ASSUME);
+}
+
+// stable, so that BuildParallel() can keep the last of several entries with the same key. Every
+// thread sorts a run of its own, then neighbouring runs are merged pairwise, back and forth
+// between entries and a buffer, each merge split into independent pieces at the positions of
+// evenly spaced elements of its left run.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::SortByKey(Entries& entries,
+                                                                const std::size_t threads) const
+{
+    const std::size_t n = entries.size();
+    const std::size_t runs = std::clamp<std::size_t>(n / kParallelGrain, 1, threads);
+
+    const auto by_key = [this](const std::pair<Key, Value>& lhs, const std::pair<Key, Value>& rhs) {
+        return m_comparator(lhs.first, rhs.first);
+    };
+
+    std::vector<std::size_t> bounds(runs + 1);
+    for (std::size_t i = 0; i <= runs; i++)
+        bounds[i] = n * i / runs;
+
+    RunParallel(runs, [&](const std::size_t i) {
+        std::stable_sort(entries.begin() + bounds[i], entries.begin() + bounds[i + 1], by_key);
+    });
+
+    if (runs == 1)
+        return;
+
+    Entries buffer(n);
+
+    while (bounds.size() > 2) {
+        const std::size_t pairs = (bounds.size() - 1) / 2;
+        const std::size_t pieces = std::max<std::size_t>(threads / pairs, 1);
+
+        const auto in = std::make_move_iterator(entries.begin());
+        std::vector<std::function<void()>> tasks;
+        std::vector<std::size_t> merged;
+
+        for (std::size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            const std::size_t lo = bounds[i];
+            const std::size_t mid = bounds[i + 1];
+            const std::size_t hi = bounds[i + 2];
+
+            // the elements of the right run that go before left run element a
+            const auto split = [&, mid, hi](const std::size_t a) -> std::size_t {
+                if (a == mid)
+                    return hi;
+
+                return std::lower_bound(entries.begin() + mid, entries.begin() + hi, entries[a],
+                                        by_key)
+                    - entries.begin();
+            };
+
+            for (std::size_t j = 0; j < pieces; j++) {
+                const std::size_t a_begin = lo + (mid - lo) * j / pieces;
+                const std::size_t a_end = lo + (mid - lo) * (j + 1) / pieces;
+                const std::size_t b_begin = (j == 0) ? mid : split(a_begin);
+                const std::size_t b_end = (j + 1 == pieces) ? hi : split(a_end);
+                const std::size_t out = a_begin + b_begin - mid;
+
+                tasks.emplace_back([&, in, a_begin, a_end, b_begin, b_end, out] {
+                    std::merge(in + a_begin, in + a_end, in + b_begin, in + b_end,
+                               buffer.begin() + out, by_key);
+                });
+            }
+
+            merged.push_back(lo);
+        }
+
+        // an odd run out has nothing to merge with this round
+        if (bounds.size() % 2 == 0) {
+            const std::size_t lo = bounds[bounds.size() - 2];
+            tasks.emplace_back([&, in, lo] { std::move(in + lo, in + n, buffer.begin() + lo); });
+            merged.push_back(lo);
+        }
+
+        RunParallel(tasks.size(), [&](const std::size_t i) { tasks[i](); });
+
+        merged.push_back(n);
+        bounds.swap(merged);
+        entries.swap(buffer);
+    }
+}
+
+// fn(0) runs on the calling thread, fn(1) to fn(count - 1) on threads of their own
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Function>
+void Map<Key, Value, Allocator, Augmentation, Stats>::RunParallel(const std::size_t count,
+                                                                  Function fn)
+{
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(count);
+
+    for (std::size_t i = 1; i < count; i++)
+        tasks.push_back(std::async(std::launch::async, [&fn, i] { fn(i); }));
+
+    if (count > 0)
+        fn(0);
+
+    for (std::future<void>& task : tasks)
+        task.get();
+}
+
+// a tree split by the middle element has every level full except the last one, painting only
+// that last level red keeps the black height equal on every path
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::RedDepth(const std::size_t n)
+{
+    std::size_t red_depth = 0;
+    while ((std::size_t(2) << red_depth) <= n + 1)
+        red_depth++;
+
+    return red_depth;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class ForwardIt>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::BuildSubtree(ForwardIt& first, const std::size_t n,
+                                                              const std::size_t depth,
+                                                              const std::size_t red_depth,
+                                                              Pool& pool)
+{
+    if (n == 0)
+        return m_sentinel;
+
+    // the input is consumed in order: left subtree, this node, right subtree
+    const std::size_t left_size = (n - 1) / 2;
+    NodePtr left = BuildSubtree(first, left_size, depth + 1, red_depth, pool);
+
+    // *first rather than its members, so that a move iterator moves the value in
+    const Color color = (depth == red_depth) ? Color::RED : Color::BLACK;
+    NodePtr node = pool.Create(Link(nullptr, color), m_sentinel, m_sentinel, *first);
+    Stats::Count(MapCounter::ALLOCATIONS);
+    ++first;
+
+    node->left = left;
+    if (left != m_sentinel)
+        SetParent(left, node);
+
+    node->right = BuildSubtree(first, n - 1 - left_size, depth + 1, red_depth, pool);
+    if (node->right != m_sentinel)
+        SetParent(node->right, node);
+
+    Refresh(node);
+    return node;
+}
+
+// the same shape as BuildSubtree(), the left subtree goes to a new thread with the first half of
+// the pools while this thread builds the node and the right subtree from the other half
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class RandomIt>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::BuildSubtreeParallel(RandomIt first,
+                                                                      const std::size_t n,
+                                                                      const std::size_t depth,
+                                                                      const std::size_t red_depth,
+                                                                      Pool* pools,
+                                                                      const std::size_t threads)
+{
+    if (threads == 1 || n < kParallelGrain) {
+        pools->Reserve(pools->Live() + n);
+        return BuildSubtree(first, n, depth, red_depth, *pools);
     }
 
-    if (y != nullptr)
-        y->parent = x->parent;
+    const std::size_t left_size = (n - 1) / 2;
+    const std::size_t left_threads = threads / 2;
+
+    std::future<NodePtr> left
+        = std::async(std::launch::async, [this, first, left_size, depth, red_depth, pools,
+                                          left_threads] {
+              return BuildSubtreeParallel(first, left_size, depth + 1, red_depth, pools,
+                                          left_threads);
+          });
+
+    const Color color = (depth == red_depth) ? Color::RED : Color::BLACK;
+    NodePtr node = pools[left_threads].Create(Link(nullptr, color), m_sentinel, m_sentinel,
+                                              first[left_size]);
+    Stats::Count(MapCounter::ALLOCATIONS);
+
+    node->right = BuildSubtreeParallel(first + left_size + 1, n - 1 - left_size, depth + 1,
+                                       red_depth, pools + left_threads, threads - left_threads);
+    if (node->right != m_sentinel)
+        SetParent(node->right, node);
+
+    node->left = left.get();
+    if (node->left != m_sentinel)
+        SetParent(node->left, node);
+
+    Refresh(node);
+    return node;
 }
 
-template <class Key, class Value>
-inline typename Map<Key, Value>::NodePtr Map<Key, Value>::Sibling(ConstNodePtr node)
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Swap(Map& other)
 {
-    if (node->parent) {
-        if (LeftChild(node)) {
-            return node->parent->right;
+    std::swap(m_pool, other.m_pool);
+    std::swap(m_root, other.m_root);
+    std::swap(m_sentinel, other.m_sentinel);
+    std::swap(m_size, other.m_size);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::SetRoot(NodePtr root)
+{
+    m_root = root;
+
+    if (root != m_sentinel) {
+        SetParent(root, nullptr);
+        SetColor(root, Color::BLACK);
+    }
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline typename Map<Key, Value, Allocator, Augmentation, Stats>::Summary&
+Map<Key, Value, Allocator, Augmentation, Stats>::SummaryOf(ConstNodePtr node)
+{
+    return *node;
+}
+
+// the sentinel keeps the summary of an empty subtree, it is never refreshed
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+inline void Map<Key, Value, Allocator, Augmentation, Stats>::Refresh(ConstNodePtr node)
+{
+    Augmentation::Update(SummaryOf(node), SummaryOf(node->left), node->entry,
+                         SummaryOf(node->right));
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::RefreshPath(NodePtr node)
+{
+    if constexpr (std::is_same_v<Augmentation, NoAugmentation>)
+        return;
+
+    for (; node != nullptr && node != m_sentinel; node = Parent(node))
+        Refresh(node);
+}
+
+// the node with index smaller keys, m_sentinel if there are not that many
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::SelectNode(std::size_t index) const
+{
+    static_assert(CountsSubtreeSize<Augmentation>::value,
+                  "Select() needs an augmentation that counts subtree sizes");
+
+    if (index >= m_size)
+        return m_sentinel;
+
+    NodePtr node = m_root;
+
+    while (true) {
+        const std::size_t left_size = SummaryOf(node->left).size;
+
+        if (index == left_size)
+            return node;
+
+        if (index < left_size) {
+            node = node->left;
         } else {
-            return node->parent->left;
+            index -= left_size + 1;
+            node = node->right;
         }
-    } else {
-        return nullptr;
     }
 }
 
-template <class Key, class Value> void Map<Key, Value>::DeleteTree(NodePtr node)
+// the nodes of other become ours, other is left empty
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::AdoptTree(Map& other)
 {
-    if (node == m_sentinel || node == nullptr)
-        return;
+    Tree tree { m_sentinel, 0 };
+
+    if (other.m_root != other.m_sentinel) {
+        tree = { other.m_root, other.BlackHeight(other.m_root) };
+        Retarget(other.m_root, other.m_sentinel);
+    }
+
+    m_pool.Adopt(std::move(other.m_pool));
+    other.m_root = other.m_sentinel;
+    SetParent(other.m_sentinel, nullptr);
+    other.m_size = 0;
+
+    return tree;
+}
 
-    DeleteTree(node->left);
-    DeleteTree(node->right);
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::Retarget(NodePtr node,
+                                                               const Node* old_sentinel)
+{
+    if (node->left == old_sentinel)
+        node->left = m_sentinel;
+    else
+        Retarget(node->left, old_sentinel);
 
-    delete node;
+    if (node->right == old_sentinel)
+        node->right = m_sentinel;
+    else
+        Retarget(node->right, old_sentinel);
 }
 
-template <class Key, class Value> void Map<Key, Value>::CopyNode(NodePtr node, NodePtr sentinel)
+// destroys the detached subtrees rooted at roots, returns how many nodes they had
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t
+Map<Key, Value, Allocator, Augmentation, Stats>::ReleaseNodes(const std::vector<NodePtr>& roots)
 {
-    if (node == sentinel)
-        return;
+    std::size_t count = 0;
+
+    for (NodePtr node : roots) {
+        // the same flattening as DeleteTree(), but each node goes back to the pool
+        while (node != m_sentinel) {
+            if (node->left != m_sentinel) {
+                NodePtr left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            } else {
+                NodePtr right = node->right;
+                m_pool.Destroy(node);
+                node = right;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::BlackHeight(const Node* root) const
+{
+    std::size_t height = 0;
+
+    for (; root != m_sentinel; root = root->left) {
+        if (GetColor(root) == Color::BLACK)
+            height++;
+    }
+
+    return height;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::size_t Map<Key, Value, Allocator, Augmentation, Stats>::Workers(const std::size_t threads,
+                                                                     const std::size_t n)
+{
+    return (n < kParallelGrain) ? 1 : std::max<std::size_t>(threads, 1);
+}
+
+// node goes between left and right, whose keys have to be smaller and larger than its own. The
+// taller tree is walked down its spine to a black node as high as the other tree, node replaces
+// it in red, and the red-red conflict this may cause is rotated away on the way back up.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::Join(const Tree& left, NodePtr node,
+                                                      const Tree& right)
+{
+    if (left.black_height > right.black_height) {
+        NodePtr root = JoinRight(left.root, left.black_height, node, right);
+
+        if (GetColor(root) == Color::RED && GetColor(root->right) == Color::RED) {
+            SetColor(root, Color::BLACK);
+            return { root, left.black_height + 1 };
+        }
+
+        return { root, left.black_height };
+    }
+
+    if (left.black_height < right.black_height) {
+        NodePtr root = JoinLeft(left, node, right.root, right.black_height);
+
+        if (GetColor(root) == Color::RED && GetColor(root->left) == Color::RED) {
+            SetColor(root, Color::BLACK);
+            return { root, right.black_height + 1 };
+        }
+
+        return { root, right.black_height };
+    }
+
+    const bool red
+        = GetColor(left.root) == Color::BLACK && GetColor(right.root) == Color::BLACK;
+
+    node->left = left.root;
+    if (left.root != m_sentinel)
+        SetParent(left.root, node);
+
+    node->right = right.root;
+    if (right.root != m_sentinel)
+        SetParent(right.root, node);
+
+    SetColor(node, red ? Color::RED : Color::BLACK);
+    Refresh(node);
+
+    return { node, left.black_height + (red ? 0 : 1) };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::JoinRight(NodePtr left,
+                                                           const std::size_t left_height,
+                                                           NodePtr node, const Tree& right)
+{
+    if (GetColor(left) == Color::BLACK && left_height == right.black_height) {
+        node->left = left;
+        if (left != m_sentinel)
+            SetParent(left, node);
+
+        node->right = right.root;
+        if (right.root != m_sentinel)
+            SetParent(right.root, node);
+
+        SetColor(node, Color::RED);
+        Refresh(node);
+        return node;
+    }
+
+    const bool black = GetColor(left) == Color::BLACK;
+    NodePtr child = JoinRight(left->right, left_height - (black ? 1 : 0), node, right);
+
+    left->right = child;
+    SetParent(child, left);
+    Refresh(left);
+
+    if (black && GetColor(child) == Color::RED && GetColor(child->right) == Color::RED) {
+        SetColor(child->right, Color::BLACK);
+        return RotatedLeft(left);
+    }
+
+    return left;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::JoinLeft(const Tree& left, NodePtr node,
+                                                          NodePtr right,
+                                                          const std::size_t right_height)
+{
+    if (GetColor(right) == Color::BLACK && right_height == left.black_height) {
+        node->left = left.root;
+        if (left.root != m_sentinel)
+            SetParent(left.root, node);
+
+        node->right = right;
+        if (right != m_sentinel)
+            SetParent(right, node);
+
+        SetColor(node, Color::RED);
+        Refresh(node);
+        return node;
+    }
+
+    const bool black = GetColor(right) == Color::BLACK;
+    NodePtr child = JoinLeft(left, node, right->left, right_height - (black ? 1 : 0));
+
+    right->left = child;
+    SetParent(child, right);
+    Refresh(right);
+
+    if (black && GetColor(child) == Color::RED && GetColor(child->left) == Color::RED) {
+        SetColor(child->left, Color::BLACK);
+        return RotatedRight(right);
+    }
+
+    return right;
+}
+
+// Join() without a node in between, the last node of left takes that place
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::Join(const Tree& left, const Tree& right)
+{
+    if (left.root == m_sentinel)
+        return right;
+
+    if (right.root == m_sentinel)
+        return left;
+
+    const auto [rest, last] = SplitLast(left);
+    return Join(rest, last, right);
+}
+
+// unlike LeftRotate() these leave the parent of x alone, the caller links the new subtree root
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::RotatedLeft(NodePtr x)
+{
+    NodePtr y = x->right;
+
+    x->right = y->left;
+    if (y->left != m_sentinel)
+        SetParent(y->left, x);
+
+    y->left = x;
+    SetParent(x, y);
+
+    Refresh(x);
+    Refresh(y);
+    Stats::Count(MapCounter::ROTATIONS);
+
+    return y;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr
+Map<Key, Value, Allocator, Augmentation, Stats>::RotatedRight(NodePtr x)
+{
+    NodePtr y = x->left;
+
+    x->left = y->right;
+    if (y->right != m_sentinel)
+        SetParent(y->right, x);
+
+    y->right = x;
+    SetParent(x, y);
+
+    Refresh(x);
+    Refresh(y);
+    Stats::Count(MapCounter::ROTATIONS);
+
+    return y;
+}
 
-    CopyNode(node->left, sentinel);
-    CopyNode(node->right, sentinel);
+// one Join() per level on the way back up, O(log n) in total since the heights joined only grow
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::SplitResult
+Map<Key, Value, Allocator, Augmentation, Stats>::Split(const Tree& tree, const Key& key)
+{
+    if (tree.root == m_sentinel)
+        return { tree, nullptr, tree };
+
+    NodePtr node = tree.root;
+    const std::size_t child_height
+        = tree.black_height - (GetColor(node) == Color::BLACK ? 1 : 0);
+    const Tree left { node->left, child_height };
+    const Tree right { node->right, child_height };
+
+    if (m_comparator(key, node->entry.first)) {
+        SplitResult split = Split(left, key);
+        split.right = Join(split.right, node, right);
+        return split;
+    }
+
+    if (m_comparator(node->entry.first, key)) {
+        SplitResult split = Split(right, key);
+        split.left = Join(left, node, split.left);
+        return split;
+    }
+
+    node->left = m_sentinel;
+    node->right = m_sentinel;
+
+    return { left, node, right };
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree,
+          typename Map<Key, Value, Allocator, Augmentation, Stats>::NodePtr>
+Map<Key, Value, Allocator, Augmentation, Stats>::SplitLast(const Tree& tree)
+{
+    NodePtr node = tree.root;
+    const std::size_t child_height
+        = tree.black_height - (GetColor(node) == Color::BLACK ? 1 : 0);
+    const Tree left { node->left, child_height };
+
+    if (node->right == m_sentinel) {
+        node->left = m_sentinel;
+        return { left, node };
+    }
+
+    const auto [rest, last] = SplitLast({ node->right, child_height });
+    return { Join(left, node, rest), last };
+}
+
+// runs left and right, on two threads with half of the threads each when there are threads to
+// spare. The nodes left drops are only added to dropped once it is done.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class LeftFn, class RightFn>
+std::pair<typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree,
+          typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree>
+Map<Key, Value, Allocator, Augmentation, Stats>::Fork(const std::size_t threads,
+                                                      std::vector<NodePtr>& dropped, LeftFn left,
+                                                      RightFn right)
+{
+    if (threads <= 1) {
+        const Tree left_tree = left(1, dropped);
+        return { left_tree, right(1, dropped) };
+    }
+
+    std::vector<NodePtr> left_dropped;
+    std::future<Tree> left_tree
+        = std::async(std::launch::async, [&] { return left(threads / 2, left_dropped); });
+    const Tree right_tree = right(threads - threads / 2, dropped);
+
+    const std::pair<Tree, Tree> trees { left_tree.get(), right_tree };
+    dropped.insert(dropped.end(), left_dropped.begin(), left_dropped.end());
+
+    return trees;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Merge>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::UnionTrees(const Tree& ours, const Tree& theirs,
+                                                            Merge& merge, const bool swapped,
+                                                            const std::size_t threads,
+                                                            std::vector<NodePtr>& dropped)
+{
+    if (theirs.root == m_sentinel)
+        return ours;
+
+    if (ours.root == m_sentinel)
+        return theirs;
+
+    // the root of theirs stays, a node of ours with the same key is dropped
+    NodePtr node = theirs.root;
+    const SplitResult split = Split(ours, node->entry.first);
+
+    if (split.node != nullptr) {
+        if (swapped)
+            node->entry.second = merge(node->entry.second, split.node->entry.second);
+        else
+            node->entry.second = merge(split.node->entry.second, node->entry.second);
+
+        dropped.push_back(split.node);
+    }
+
+    const std::size_t child_height
+        = theirs.black_height - (GetColor(node) == Color::BLACK ? 1 : 0);
+    const Tree left { node->left, child_height };
+    const Tree right { node->right, child_height };
+
+    const auto [left_tree, right_tree] = Fork(
+        threads, dropped,
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return UnionTrees(split.left, left, merge, swapped, workers, drop);
+        },
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return UnionTrees(split.right, right, merge, swapped, workers, drop);
+        });
+
+    return Join(left_tree, node, right_tree);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class Merge>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::IntersectTrees(const Tree& ours,
+                                                                const Node* theirs,
+                                                                const Map& other, Merge& merge,
+                                                                const std::size_t threads,
+                                                                std::vector<NodePtr>& dropped)
+{
+    if (ours.root == m_sentinel)
+        return ours;
+
+    if (theirs == other.m_sentinel) {
+        dropped.push_back(ours.root);
+        return { m_sentinel, 0 };
+    }
+
+    const SplitResult split = Split(ours, theirs->entry.first);
+
+    const auto [left_tree, right_tree] = Fork(
+        threads, dropped,
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return IntersectTrees(split.left, theirs->left, other, merge, workers, drop);
+        },
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return IntersectTrees(split.right, theirs->right, other, merge, workers, drop);
+        });
+
+    if (split.node == nullptr)
+        return Join(left_tree, right_tree);
+
+    split.node->entry.second = merge(split.node->entry.second, theirs->entry.second);
+    return Join(left_tree, split.node, right_tree);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::Tree
+Map<Key, Value, Allocator, Augmentation, Stats>::DifferenceTrees(const Tree& ours,
+                                                                 const Node* theirs,
+                                                                 const Map& other,
+                                                                 const std::size_t threads,
+                                                                 std::vector<NodePtr>& dropped)
+{
+    if (ours.root == m_sentinel || theirs == other.m_sentinel)
+        return ours;
 
-    Insert(node->key, node->value);
+    const SplitResult split = Split(ours, theirs->entry.first);
+
+    if (split.node != nullptr)
+        dropped.push_back(split.node);
+
+    const auto [left_tree, right_tree] = Fork(
+        threads, dropped,
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return DifferenceTrees(split.left, theirs->left, other, workers, drop);
+        },
+        [&](const std::size_t workers, std::vector<NodePtr>& drop) {
+            return DifferenceTrees(split.right, theirs->right, other, workers, drop);
+        });
+
+    return Join(left_tree, right_tree);
 }
 
-template <class Key, class Value> void Map<Key, Value>::SaveTree(const std::string& filename) const
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::SaveTree(const std::string& filename) const
 {
     if (m_root == m_sentinel)
         return;
@@ -479,47 +2305,263 @@ template <class Key, class Value> void Map<Key, Value>::SaveTree(const std::stri
     fout << "digraph g{\n";
     fout << "node [shape = record,height = .1];\n";
 
-    std::queue<Node*> q;
-    q.push(m_root);
+    // node ids only matter to the exporter, so they travel with the queue instead of the nodes
+    std::queue<std::pair<const Node*, int>> q;
+    q.push({ m_root, 0 });
 
     fout << " node0"
-         << "[label = \"<f0> |<f1>" << m_root->key << "|<f2>\", color=" << m_root->color << "];\n";
+         << "[label = \"<f0> |<f1>" << m_root->entry.first << "|<f2>\", color=" << GetColor(m_root)
+         << "];\n";
 
     while (!q.empty()) {
-        Node* node = q.front();
+        const Node* node = q.front().first;
+        const int node_id = q.front().second;
         q.pop();
 
         if (node->left) {
-            node->left->id = id;
+            const int left_id = id;
             id++;
-            q.push(node->left);
+            q.push({ node->left, left_id });
             if (node->left == m_sentinel) {
-                fout << " node" << node->left->id << "[label = \"<f0> |<f1>"
+                fout << " node" << left_id << "[label = \"<f0> |<f1>"
                      << "NULL"
-                     << "|<f2>\", color=" << node->left->color << "];\n";
+                     << "|<f2>\", color=" << GetColor(node->left) << "];\n";
             } else {
-                fout << " node" << node->left->id << "[label = \"<f0> |<f1>" << node->left->key
-                     << "|<f2>\", color=" << node->left->color << "];\n";
+                fout << " node" << left_id << "[label = \"<f0> |<f1>" << node->left->entry.first
+                     << "|<f2>\", color=" << GetColor(node->left) << "];\n";
             }
-            fout << "\"node" << node->id << "\":f0->\"node" << node->left->id << "\":f1;\n";
+            fout << "\"node" << node_id << "\":f0->\"node" << left_id << "\":f1;\n";
         }
 
         if (node->right) {
-            node->right->id = id;
+            const int right_id = id;
             id++;
-            q.push(node->right);
+            q.push({ node->right, right_id });
             if (node->right == m_sentinel) {
-                fout << " node" << node->right->id << "[label = \"<f0> |<f1>"
+                fout << " node" << right_id << "[label = \"<f0> |<f1>"
                      << "NULL"
-                     << "|<f2>\", color=" << node->right->color << "];\n";
+                     << "|<f2>\", color=" << GetColor(node->right) << "];\n";
             } else {
-                fout << " node" << node->right->id << "[label = \"<f0> |<f1>" << node->right->key
-                     << "|<f2>\", color=" << node->right->color << "];\n";
+                fout << " node" << right_id << "[label = \"<f0> |<f1>" << node->right->entry.first
+                     << "|<f2>\", color=" << GetColor(node->right) << "];\n";
             }
-            fout << "\"node" << node->id << "\":f2->\"node" << node->right->id << "\":f1;\n";
+            fout << "\"node" << node_id << "\":f2->\"node" << right_id << "\":f1;\n";
         }
     }
 
     fout << "}\n";
     fout.close();
 }
+
+// the keys in order, then the values in order, see snapshot.h. One walk over the tree fills both
+// sections, it is the pointer chasing and not the writing that takes the time.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::SaveBinary(const std::string& filename) const
+{
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "snapshots hold raw copies of trivially copyable keys and values");
+
+    SnapshotWriter writer(filename, m_size, sizeof(Key), sizeof(Value));
+
+    for (const auto& entry : *this)
+        writer.Append(&entry.first, &entry.second);
+
+    writer.Finish();
+}
+
+// the snapshot is sorted already, so the tree is built bottom up in O(n) straight from the mapped
+// file without an intermediate copy. A file whose checksum was not checked has its order checked.
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::LoadBinary(const std::string& filename,
+                                                                 const ChecksumMode mode)
+{
+    const MappedMap<Key, Value> snapshot(filename, mode);
+    const SortedMode sorted
+        = (mode == ChecksumMode::VERIFY) ? SortedMode::ASSUME : SortedMode::VERIFY;
+
+    BuildFromSorted(snapshot.begin(), snapshot.end(), sorted);
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <class... Args>
+Map<Key, Value, Allocator, Augmentation, Stats>::Node::Node(const std::uintptr_t parent_color,
+                                                            Node* left, Node* right, Args&&... args)
+    : entry(std::forward<Args>(args)...)
+    , parent_color(parent_color)
+    , left(left)
+    , right(right)
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::NodeHandle()
+    : m_node(nullptr)
+    , m_share()
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::NodeHandle(
+    NodePtr node, typename Pool::Share&& share)
+    : m_node(node)
+    , m_share(std::move(share))
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::NodeHandle(NodeHandle&& other) noexcept
+    : m_node(other.m_node)
+    , m_share(std::move(other.m_share))
+{
+    other.m_node = nullptr;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle&
+Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::operator=(NodeHandle&& other) noexcept
+{
+    if (this != &other) {
+        Reset();
+
+        m_node = other.m_node;
+        m_share = std::move(other.m_share);
+        other.m_node = nullptr;
+    }
+
+    return *this;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::~NodeHandle()
+{
+    Reset();
+}
+
+// the entry is destroyed and the slot goes back to the pool of the map it was extracted from
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+void Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::Reset()
+{
+    if (m_node != nullptr)
+        Pool::Dispose(m_node, m_share);
+
+    m_node = nullptr;
+    m_share = typename Pool::Share();
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::Empty() const
+{
+    return m_node == nullptr;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+const Key& Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::GetKey() const
+{
+    return m_node->entry.first;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+Value& Map<Key, Value, Allocator, Augmentation, Stats>::NodeHandle::GetValue()
+{
+    return m_node->entry.second;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::Iterator()
+    : m_node(nullptr)
+    , m_map(nullptr)
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::Iterator(
+    const Iterator<false>& other)
+    : m_node(other.m_node)
+    , m_map(other.m_map)
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::Iterator(NodePtr node,
+                                                                             const Map* map)
+    : m_node(node)
+    , m_map(map)
+{
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>::reference
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator*() const
+{
+    return m_node->entry;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>::pointer
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator->() const
+{
+    return &m_node->entry;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>&
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator++()
+{
+    m_node = m_map->Successor(m_node);
+
+    return *this;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator++(int)
+{
+    Iterator previous = *this;
+    m_node = m_map->Successor(m_node);
+
+    return previous;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>&
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator--()
+{
+    m_node = m_map->Predecessor(m_node);
+
+    return *this;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+typename Map<Key, Value, Allocator, Augmentation, Stats>::template Iterator<IsConst>
+Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator--(int)
+{
+    Iterator previous = *this;
+    m_node = m_map->Predecessor(m_node);
+
+    return previous;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator==(
+    const Iterator& other) const
+{
+    return m_node == other.m_node;
+}
+
+template <class Key, class Value, class Allocator, class Augmentation, class Stats>
+template <bool IsConst>
+bool Map<Key, Value, Allocator, Augmentation, Stats>::Iterator<IsConst>::operator!=(
+    const Iterator& other) const
+{
+    return m_node != other.m_node;
+}
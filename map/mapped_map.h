@@ -0,0 +1,108 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "snapshot.h"
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// VERIFY reads the whole file once to check its checksum, SKIP only checks the header
+enum class ChecksumMode { VERIFY = 0, SKIP };
+
+/*
+ * Read-only map served straight from a snapshot file written by Map::SaveBinary().
+ *
+ * The file is mapped with mmap() and lookups binary search the sorted key array in the mapped
+ * pages, nothing is copied or deserialized. Opening is O(1) with ChecksumMode::SKIP, the pages
+ * are read in by the lookups that touch them and stay in the page cache, shared by every process
+ * that maps the same file. The map owns the mapping and can be moved but not copied.
+ */
+template <class Key, class Value> class MappedMap {
+
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "snapshots hold raw copies of trivially copyable keys and values");
+    static_assert(alignof(Key) <= SnapshotHeader::kAlignment
+                      && alignof(Value) <= SnapshotHeader::kAlignment,
+                  "snapshot sections are only 64 byte aligned");
+
+public:
+    class Iterator {
+        friend class MappedMap;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<const Key, Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const Key&, const Value&>;
+
+        // keys and values are apart, so -> has to point into a temporary pair of references
+        struct pointer {
+            reference entry;
+            const reference* operator->() const { return &entry; }
+        };
+
+        Iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        Iterator& operator--();
+        Iterator operator--(int);
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        Iterator(const std::size_t index, const MappedMap* map);
+
+        std::size_t m_index;
+        const MappedMap* m_map;
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+
+    explicit MappedMap(const std::string& filename, const ChecksumMode mode = ChecksumMode::VERIFY);
+    MappedMap(const MappedMap& other) = delete;
+    MappedMap& operator=(const MappedMap& other) = delete;
+    MappedMap(MappedMap&& other);
+    MappedMap& operator=(MappedMap&& other);
+    ~MappedMap();
+
+    Value At(const Key& key) const;
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    std::size_t Size() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    std::size_t MappedBytes() const;
+
+private:
+    std::size_t LowerBoundIndex(const Key& key) const;
+    void Unmap();
+
+private:
+    std::less<Key> m_comparator;
+    void* m_data;
+    std::size_t m_length;
+    const Key* m_keys;
+    const Value* m_values;
+    std::size_t m_size;
+};
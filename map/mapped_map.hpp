@@ -0,0 +1,272 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "mapped_map.h"
+#include "snapshot.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template <class Key, class Value>
+MappedMap<Key, Value>::MappedMap(const std::string& filename, const ChecksumMode mode)
+    : m_comparator()
+    , m_data(nullptr)
+    , m_length(0)
+    , m_keys(nullptr)
+    , m_values(nullptr)
+    , m_size(0)
+{
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open snapshot: " + filename);
+
+    struct stat status;
+    if (::fstat(fd, &status) != 0
+        || static_cast<std::size_t>(status.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("not a map snapshot: " + filename);
+    }
+
+    // the mapping keeps the file alive, the descriptor is not needed any more
+    m_length = static_cast<std::size_t>(status.st_size);
+    void* data = ::mmap(nullptr, m_length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        throw std::runtime_error("cannot map snapshot: " + filename);
+
+    m_data = data;
+
+    const SnapshotHeader& header = *static_cast<const SnapshotHeader*>(m_data);
+    const std::size_t payload = m_length - sizeof(SnapshotHeader);
+
+    // the size is checked against the file before it is multiplied, a corrupt one cannot overflow
+    const bool valid = header.magic == SnapshotHeader::kMagic
+        && header.version == SnapshotHeader::kVersion && header.key_size == sizeof(Key)
+        && header.value_size == sizeof(Value) && header.size <= payload
+        && SnapshotHeader::Padded(header.size * sizeof(Key))
+                + SnapshotHeader::Padded(header.size * sizeof(Value))
+            == payload;
+
+    if (!valid) {
+        Unmap();
+        throw std::runtime_error("not a map snapshot of these key and value types: " + filename);
+    }
+
+    const unsigned char* keys = static_cast<const unsigned char*>(m_data) + sizeof(header);
+    const std::size_t key_bytes = SnapshotHeader::Padded(header.size * sizeof(Key));
+    const unsigned char* values = keys + key_bytes;
+
+    if (mode == ChecksumMode::VERIFY
+        && (SnapshotChecksum::Update(SnapshotChecksum::kOffsetBasis, keys, key_bytes)
+                != header.key_checksum
+            || SnapshotChecksum::Update(SnapshotChecksum::kOffsetBasis, values,
+                                        payload - key_bytes)
+                != header.value_checksum)) {
+        Unmap();
+        throw std::runtime_error("snapshot checksum mismatch: " + filename);
+    }
+
+    m_size = static_cast<std::size_t>(header.size);
+    m_keys = reinterpret_cast<const Key*>(keys);
+    m_values = reinterpret_cast<const Value*>(values);
+}
+
+template <class Key, class Value>
+MappedMap<Key, Value>::MappedMap(MappedMap&& other)
+    : m_comparator()
+    , m_data(std::exchange(other.m_data, nullptr))
+    , m_length(std::exchange(other.m_length, 0))
+    , m_keys(std::exchange(other.m_keys, nullptr))
+    , m_values(std::exchange(other.m_values, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+template <class Key, class Value>
+MappedMap<Key, Value>& MappedMap<Key, Value>::operator=(MappedMap&& other)
+{
+    if (this != &other) {
+        Unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_length = std::exchange(other.m_length, 0);
+        m_keys = std::exchange(other.m_keys, nullptr);
+        m_values = std::exchange(other.m_values, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+
+    return *this;
+}
+
+template <class Key, class Value> MappedMap<Key, Value>::~MappedMap() { Unmap(); }
+
+template <class Key, class Value> Value MappedMap<Key, Value>::At(const Key& key) const
+{
+    const Value* value = Find(key);
+
+    if (value == nullptr) {
+        if constexpr (std::is_arithmetic_v<Key>)
+            throw std::out_of_range("invalid key: " + std::to_string(key));
+        else
+            throw std::out_of_range("invalid key");
+    }
+
+    return *value;
+}
+
+template <class Key, class Value>
+const Value* MappedMap<Key, Value>::Find(const Key& key) const
+{
+    const std::size_t index = LowerBoundIndex(key);
+
+    if (index == m_size || m_comparator(key, m_keys[index]))
+        return nullptr;
+
+    return &m_values[index];
+}
+
+template <class Key, class Value> bool MappedMap<Key, Value>::Contains(const Key& key) const
+{
+    return Find(key) != nullptr;
+}
+
+template <class Key, class Value> std::size_t MappedMap<Key, Value>::Size() const
+{
+    return m_size;
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::const_iterator MappedMap<Key, Value>::begin() const
+{
+    return const_iterator(0, this);
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::const_iterator MappedMap<Key, Value>::end() const
+{
+    return const_iterator(m_size, this);
+}
+
+// the pages are in the page cache rather than on the heap, MemoryUsage() would not fit
+template <class Key, class Value> std::size_t MappedMap<Key, Value>::MappedBytes() const
+{
+    return m_length;
+}
+
+// halving without a branch on the comparison, the loads of the next step do not wait for it
+template <class Key, class Value>
+std::size_t MappedMap<Key, Value>::LowerBoundIndex(const Key& key) const
+{
+    if (m_size == 0)
+        return 0;
+
+    const Key* base = m_keys;
+    std::size_t n = m_size;
+
+    while (n > 1) {
+        const std::size_t half = n / 2;
+        base = m_comparator(base[half], key) ? base + half : base;
+        n -= half;
+    }
+
+    return static_cast<std::size_t>(base - m_keys) + m_comparator(*base, key);
+}
+
+template <class Key, class Value> void MappedMap<Key, Value>::Unmap()
+{
+    if (m_data != nullptr)
+        ::munmap(m_data, m_length);
+
+    m_data = nullptr;
+}
+
+template <class Key, class Value>
+MappedMap<Key, Value>::Iterator::Iterator()
+    : m_index(0)
+    , m_map(nullptr)
+{
+}
+
+template <class Key, class Value>
+MappedMap<Key, Value>::Iterator::Iterator(const std::size_t index, const MappedMap* map)
+    : m_index(index)
+    , m_map(map)
+{
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator::reference
+MappedMap<Key, Value>::Iterator::operator*() const
+{
+    return reference(m_map->m_keys[m_index], m_map->m_values[m_index]);
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator::pointer
+MappedMap<Key, Value>::Iterator::operator->() const
+{
+    return pointer { **this };
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator& MappedMap<Key, Value>::Iterator::operator++()
+{
+    ++m_index;
+
+    return *this;
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator MappedMap<Key, Value>::Iterator::operator++(int)
+{
+    Iterator next = *this;
+    ++m_index;
+
+    return next;
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator& MappedMap<Key, Value>::Iterator::operator--()
+{
+    --m_index;
+
+    return *this;
+}
+
+template <class Key, class Value>
+typename MappedMap<Key, Value>::Iterator MappedMap<Key, Value>::Iterator::operator--(int)
+{
+    Iterator previous = *this;
+    --m_index;
+
+    return previous;
+}
+
+template <class Key, class Value>
+bool MappedMap<Key, Value>::Iterator::operator==(const Iterator& other) const
+{
+    return m_index == other.m_index;
+}
+
+template <class Key, class Value>
+bool MappedMap<Key, Value>::Iterator::operator!=(const Iterator& other) const
+{
+    return m_index != other.m_index;
+}
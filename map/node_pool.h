@@ -0,0 +1,115 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * Slab allocator for fixed size tree nodes.
+ *
+ * Nodes are carved out of large slabs obtained from Allocator, removed nodes are kept on a free
+ * list and reused by the next Create(). Release() hands every slab back at once, it does not run
+ * any destructor so the owner has to destroy live objects first when they are not trivially
+ * destructible.
+ *
+ * An object can also leave the pool alive with Detach() and join another pool with Attach(). Its
+ * memory stays in the slabs it was carved from: the Share it travels with keeps those slabs
+ * alive, and a pool that attaches it keeps them alive from then on, until it is released itself.
+ * So one node handed from A to B holds on to every slab of A for as long as B lives, even after A
+ * is released. Only the pool that carved them ever adds slabs or takes slots from them, so pools
+ * that exchanged objects can still be used from different threads. An object that never joins
+ * another pool is given back with Dispose(), its slot goes back to the pool it was detached from.
+ */
+template <class T, class Allocator = std::allocator<T>> class NodePool {
+
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using SlotAllocatorTraits = std::allocator_traits<SlotAllocator>;
+
+    struct Slab {
+        Slot* slots;
+        std::size_t count;
+    };
+
+    // the slabs carved by one pool, and the slots disposed of by whoever held them detached,
+    // which that pool picks up when its own free list runs out
+    struct Slabs {
+        explicit Slabs(const SlotAllocator& allocator);
+        ~Slabs();
+
+        SlotAllocator allocator;
+        std::vector<Slab> slabs;
+        std::atomic<Slot*> returned;
+    };
+
+    using SlabsPtr = std::shared_ptr<Slabs>;
+    // the slabs of other pools a pool has objects in, never changed once made so that a Share
+    // can hold on to it while the pool goes on
+    using Borrowed = std::vector<SlabsPtr>;
+
+    static constexpr std::size_t kMinSlabSize = 64;
+    static constexpr std::size_t kMaxSlabSize = 1 << 16;
+
+public:
+    // every slab a detached object may live in
+    struct Share {
+        SlabsPtr slabs;
+        std::shared_ptr<const Borrowed> borrowed;
+    };
+
+    explicit NodePool(const Allocator& allocator = Allocator());
+    NodePool(const NodePool& other) = delete;
+    NodePool& operator=(const NodePool& other) = delete;
+    NodePool(NodePool&& other) noexcept;
+    NodePool& operator=(NodePool&& other) noexcept;
+    ~NodePool();
+
+    template <class... Args> T* Create(Args&&... args);
+    void Destroy(T* object);
+    Share Detach(T* object);
+    bool Attach(T* object, Share& share);
+    static void Dispose(T* object, Share& share);
+    void Reserve(const std::size_t n);
+    void Release();
+    void Adopt(NodePool&& other);
+    Allocator GetAllocator() const;
+    std::size_t Capacity() const;
+    std::size_t Live() const;
+    std::size_t MemoryUsage() const;
+
+private:
+    Slot* Allocate();
+    void Grow(const std::size_t count);
+    void Keep(const Share& share);
+    bool Keeps(const SlabsPtr& slabs) const;
+
+private:
+    SlotAllocator m_allocator;
+    SlabsPtr m_slabs;
+    std::shared_ptr<const Borrowed> m_borrowed;
+    Slot* m_free;
+    Slot* m_next;
+    Slot* m_end;
+    std::size_t m_capacity;
+    std::size_t m_live;
+};
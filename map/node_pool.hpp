@@ -0,0 +1,343 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "node_pool.h"
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <utility>
+
+template <class T, class Allocator>
+NodePool<T, Allocator>::NodePool(const Allocator& allocator)
+    : m_allocator(allocator)
+    , m_slabs()
+    , m_borrowed()
+    , m_free(nullptr)
+    , m_next(nullptr)
+    , m_end(nullptr)
+    , m_capacity(0)
+    , m_live(0)
+{
+}
+
+template <class T, class Allocator>
+NodePool<T, Allocator>::Slabs::Slabs(const SlotAllocator& allocator)
+    : allocator(allocator)
+    , slabs()
+    , returned(nullptr)
+{
+}
+
+template <class T, class Allocator> NodePool<T, Allocator>::Slabs::~Slabs()
+{
+    for (const Slab& slab : slabs)
+        SlotAllocatorTraits::deallocate(allocator, slab.slots, slab.count);
+}
+
+template <class T, class Allocator>
+NodePool<T, Allocator>::NodePool(NodePool&& other) noexcept
+    : m_allocator(std::move(other.m_allocator))
+    , m_slabs(std::move(other.m_slabs))
+    , m_borrowed(std::move(other.m_borrowed))
+    , m_free(other.m_free)
+    , m_next(other.m_next)
+    , m_end(other.m_end)
+    , m_capacity(other.m_capacity)
+    , m_live(other.m_live)
+{
+    other.m_free = nullptr;
+    other.m_next = nullptr;
+    other.m_end = nullptr;
+    other.m_capacity = 0;
+    other.m_live = 0;
+}
+
+template <class T, class Allocator>
+NodePool<T, Allocator>& NodePool<T, Allocator>::operator=(NodePool&& other) noexcept
+{
+    if (this != &other) {
+        Release();
+
+        m_allocator = std::move(other.m_allocator);
+        m_slabs = std::move(other.m_slabs);
+        m_borrowed = std::move(other.m_borrowed);
+        m_free = other.m_free;
+        m_next = other.m_next;
+        m_end = other.m_end;
+        m_capacity = other.m_capacity;
+        m_live = other.m_live;
+
+        other.m_free = nullptr;
+        other.m_next = nullptr;
+        other.m_end = nullptr;
+        other.m_capacity = 0;
+        other.m_live = 0;
+    }
+
+    return *this;
+}
+
+template <class T, class Allocator> NodePool<T, Allocator>::~NodePool() { Release(); }
+
+template <class T, class Allocator>
+template <class... Args>
+T* NodePool<T, Allocator>::Create(Args&&... args)
+{
+    Slot* slot = Allocate();
+    T* object = ::new (static_cast<void*>(slot->storage)) T { std::forward<Args>(args)... };
+    m_live++;
+
+    return object;
+}
+
+template <class T, class Allocator> void NodePool<T, Allocator>::Destroy(T* object)
+{
+    if (object == nullptr)
+        return;
+
+    object->~T();
+
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = m_free;
+    m_free = slot;
+    m_live--;
+}
+
+// object leaves the pool alive, the share keeps its memory valid until some pool attaches it or
+// it is disposed of
+template <class T, class Allocator>
+typename NodePool<T, Allocator>::Share NodePool<T, Allocator>::Detach([[maybe_unused]] T* object)
+{
+    assert(object != nullptr);
+
+    // a pool that only holds attached objects has carved nothing yet, but a disposed slot still
+    // needs somewhere to go back to
+    if (m_slabs == nullptr)
+        m_slabs = std::make_shared<Slabs>(m_allocator);
+
+    m_live--;
+
+    return { m_slabs, m_borrowed };
+}
+
+// object, detached from this or another pool, joins this one when the two pools can free each
+// other's memory, i.e. their allocators compare equal, and the share is used up. Otherwise
+// nothing changes and false is returned.
+template <class T, class Allocator>
+bool NodePool<T, Allocator>::Attach([[maybe_unused]] T* object, Share& share)
+{
+    assert(object != nullptr && share.slabs != nullptr);
+
+    if (!(share.slabs->allocator == m_allocator))
+        return false;
+
+    Keep(share);
+    share = Share();
+    m_live++;
+
+    return true;
+}
+
+// destroys a detached object that joins no other pool, the pool it was detached from takes its
+// slot back the next time its free list runs out, whichever thread that pool is used from
+template <class T, class Allocator> void NodePool<T, Allocator>::Dispose(T* object, Share& share)
+{
+    assert(object != nullptr && share.slabs != nullptr);
+
+    object->~T();
+
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = share.slabs->returned.load(std::memory_order_relaxed);
+    while (!share.slabs->returned.compare_exchange_weak(slot->next, slot,
+                                                         std::memory_order_release,
+                                                         std::memory_order_relaxed)) {
+    }
+
+    share = Share();
+}
+
+template <class T, class Allocator> void NodePool<T, Allocator>::Reserve(const std::size_t n)
+{
+    if (n > m_capacity)
+        Grow(n - m_capacity);
+}
+
+// the slabs are freed right away unless a Share or another pool still holds on to them
+template <class T, class Allocator> void NodePool<T, Allocator>::Release()
+{
+    m_slabs.reset();
+    m_borrowed.reset();
+    m_free = nullptr;
+    m_next = nullptr;
+    m_end = nullptr;
+    m_capacity = 0;
+    m_live = 0;
+}
+
+// the objects alive in other and its free slots become ours. Both pools have to be able to free
+// each other's memory, i.e. their allocators compare equal.
+template <class T, class Allocator> void NodePool<T, Allocator>::Adopt(NodePool&& other)
+{
+    assert(m_allocator == other.m_allocator);
+
+    if (this == &other)
+        return;
+
+    if (other.m_slabs != nullptr && other.m_slabs.use_count() == 1) {
+        // nothing else holds on to the slabs of other, they simply move over
+        if (m_slabs == nullptr)
+            m_slabs = std::make_shared<Slabs>(m_allocator);
+
+        std::vector<Slab>& slabs = other.m_slabs->slabs;
+        m_slabs->slabs.insert(m_slabs->slabs.end(), slabs.begin(), slabs.end());
+        slabs.clear();
+
+        Slot* returned = other.m_slabs->returned.exchange(nullptr, std::memory_order_acquire);
+        while (returned != nullptr) {
+            Slot* slot = returned;
+            returned = slot->next;
+            slot->next = m_free;
+            m_free = slot;
+        }
+    } else {
+        Keep({ other.m_slabs, nullptr });
+    }
+
+    Keep({ nullptr, other.m_borrowed });
+
+    while (other.m_free != nullptr) {
+        Slot* slot = other.m_free;
+        other.m_free = slot->next;
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    while (other.m_next != other.m_end) {
+        other.m_next->next = m_free;
+        m_free = other.m_next;
+        other.m_next++;
+    }
+
+    m_capacity += other.m_capacity;
+    m_live += other.m_live;
+
+    other.Release();
+}
+
+template <class T, class Allocator> Allocator NodePool<T, Allocator>::GetAllocator() const
+{
+    return Allocator(m_allocator);
+}
+
+template <class T, class Allocator> std::size_t NodePool<T, Allocator>::Capacity() const
+{
+    return m_capacity;
+}
+
+template <class T, class Allocator> std::size_t NodePool<T, Allocator>::Live() const
+{
+    return m_live;
+}
+
+template <class T, class Allocator> std::size_t NodePool<T, Allocator>::MemoryUsage() const
+{
+    std::size_t bytes = m_capacity * sizeof(Slot);
+    if (m_slabs != nullptr)
+        bytes += sizeof(Slabs) + m_slabs->slabs.capacity() * sizeof(Slab);
+    if (m_borrowed != nullptr)
+        bytes += m_borrowed->capacity() * sizeof(SlabsPtr);
+
+    return bytes;
+}
+
+template <class T, class Allocator>
+typename NodePool<T, Allocator>::Slot* NodePool<T, Allocator>::Allocate()
+{
+    // the slots disposed of elsewhere are only picked up once ours run out
+    if (m_free == nullptr && m_slabs != nullptr
+        && m_slabs->returned.load(std::memory_order_relaxed) != nullptr)
+        m_free = m_slabs->returned.exchange(nullptr, std::memory_order_acquire);
+
+    if (m_free != nullptr) {
+        Slot* slot = m_free;
+        m_free = slot->next;
+        return slot;
+    }
+
+    if (m_next == m_end)
+        Grow(std::min(std::max(kMinSlabSize, m_capacity), kMaxSlabSize));
+
+    return m_next++;
+}
+
+template <class T, class Allocator> void NodePool<T, Allocator>::Grow(const std::size_t count)
+{
+    // the bookkeeping comes from the heap like the slab list did, only slabs come from Allocator
+    if (m_slabs == nullptr)
+        m_slabs = std::make_shared<Slabs>(m_allocator);
+
+    Slot* slots = SlotAllocatorTraits::allocate(m_allocator, count);
+    m_slabs->slabs.push_back({ slots, count });
+
+    // whatever is left in the current slab would be lost once we bump into the new one
+    while (m_next != m_end) {
+        m_next->next = m_free;
+        m_free = m_next;
+        m_next++;
+    }
+
+    m_next = slots;
+    m_end = slots + count;
+    m_capacity += count;
+}
+
+// from now on we hold on to every slab of share as well, the set we keep is only copied when it
+// grows, which happens once per pool that objects come from
+template <class T, class Allocator> void NodePool<T, Allocator>::Keep(const Share& share)
+{
+    const auto missing = [this](const SlabsPtr& slabs) {
+        return slabs != nullptr && !Keeps(slabs);
+    };
+
+    const bool complete = !missing(share.slabs)
+        && (share.borrowed == nullptr
+            || std::none_of(share.borrowed->begin(), share.borrowed->end(), missing));
+    if (complete)
+        return;
+
+    auto borrowed = m_borrowed != nullptr ? std::make_shared<Borrowed>(*m_borrowed)
+                                          : std::make_shared<Borrowed>();
+    const auto add = [&](const SlabsPtr& slabs) {
+        if (missing(slabs)
+            && std::find(borrowed->begin(), borrowed->end(), slabs) == borrowed->end())
+            borrowed->push_back(slabs);
+    };
+
+    add(share.slabs);
+    if (share.borrowed != nullptr)
+        std::for_each(share.borrowed->begin(), share.borrowed->end(), add);
+
+    m_borrowed = std::move(borrowed);
+}
+
+template <class T, class Allocator>
+bool NodePool<T, Allocator>::Keeps(const SlabsPtr& slabs) const
+{
+    return slabs == m_slabs
+        || (m_borrowed != nullptr
+            && std::find(m_borrowed->begin(), m_borrowed->end(), slabs) != m_borrowed->end());
+}
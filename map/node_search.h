@@ -0,0 +1,53 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+/*
+ * Vectorized search of a sorted key block.
+ *
+ * For signed 32 and 64 bit keys the position of a key in a node is the number of keys below it,
+ * which a packed compare and a movemask give for a whole register at a time. The instruction set
+ * is picked at compile time: AVX2 when the compiler targets it, SSE2 (32 bit) or SSE4.2 (64 bit)
+ * otherwise, and kVectorized is false when neither is available so callers keep their scalar
+ * search.
+ */
+template <class Key> struct NodeSearch {
+
+#if defined(__AVX2__)
+    static constexpr bool kHasInt32 = true;
+    static constexpr bool kHasInt64 = true;
+#elif defined(__SSE4_2__)
+    static constexpr bool kHasInt32 = true;
+    static constexpr bool kHasInt64 = true;
+#elif defined(__SSE2__)
+    static constexpr bool kHasInt32 = true;
+    static constexpr bool kHasInt64 = false;
+#else
+    static constexpr bool kHasInt32 = false;
+    static constexpr bool kHasInt64 = false;
+#endif
+
+    static constexpr bool kVectorized = std::is_integral_v<Key> && std::is_signed_v<Key>
+        && ((sizeof(Key) == 4 && kHasInt32) || (sizeof(Key) == 8 && kHasInt64));
+
+    // number of keys[i] < key, i.e. the lower bound of key in the block
+    static std::size_t CountLess(const Key* keys, const std::size_t count, const Key key);
+    // number of keys[i] <= key, i.e. the upper bound of key in the block
+    static std::size_t CountLessEqual(const Key* keys, const std::size_t count, const Key key);
+};
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "node_search.h"
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+template <class Key>
+std::size_t NodeSearch<Key>::CountLess(const Key* keys, const std::size_t count, const Key key)
+{
+    static_assert(kVectorized, "NodeSearch needs signed 32 or 64 bit keys and SIMD support");
+
+    std::size_t i = 0;
+    std::size_t less = 0;
+
+    // a lane that compares below is all ones, i.e. -1, so subtracting the compare results counts
+    // them without a movemask and popcount per block (popcnt is not part of baseline x86-64). No
+    // early exit either, blocks are short enough that finishing the loop beats a mispredict.
+    if constexpr (sizeof(Key) == 4) {
+#if defined(__SSE2__)
+#if defined(__AVX2__)
+        const __m256i needle8 = _mm256_set1_epi32(key);
+        __m256i below8 = _mm256_setzero_si256();
+
+        for (; i + 8 <= count; i += 8) {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+            below8 = _mm256_sub_epi32(below8, _mm256_cmpgt_epi32(needle8, block));
+        }
+
+        __m128i below = _mm_add_epi32(_mm256_castsi256_si128(below8),
+                                      _mm256_extracti128_si256(below8, 1));
+#else
+        __m128i below = _mm_setzero_si128();
+#endif
+        const __m128i needle = _mm_set1_epi32(key);
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+            below = _mm_sub_epi32(below, _mm_cmpgt_epi32(needle, block));
+        }
+
+        below = _mm_add_epi32(below, _mm_shuffle_epi32(below, _MM_SHUFFLE(1, 0, 3, 2)));
+        below = _mm_add_epi32(below, _mm_shuffle_epi32(below, _MM_SHUFFLE(2, 3, 0, 1)));
+        less = static_cast<std::size_t>(_mm_cvtsi128_si32(below));
+#endif
+    } else {
+#if defined(__AVX2__)
+        const __m256i needle4 = _mm256_set1_epi64x(key);
+        __m256i below4 = _mm256_setzero_si256();
+
+        for (; i + 4 <= count; i += 4) {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+            below4 = _mm256_sub_epi64(below4, _mm256_cmpgt_epi64(needle4, block));
+        }
+
+        __m128i below = _mm_add_epi64(_mm256_castsi256_si128(below4),
+                                      _mm256_extracti128_si256(below4, 1));
+#elif defined(__SSE4_2__)
+        __m128i below = _mm_setzero_si128();
+#endif
+#if defined(__SSE4_2__)
+        const __m128i needle = _mm_set1_epi64x(key);
+
+        for (; i + 2 <= count; i += 2) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+            below = _mm_sub_epi64(below, _mm_cmpgt_epi64(needle, block));
+        }
+
+        below = _mm_add_epi64(below, _mm_unpackhi_epi64(below, below));
+        less = static_cast<std::size_t>(_mm_cvtsi128_si64(below));
+#endif
+    }
+
+    for (; i < count; i++)
+        less += keys[i] < key;
+
+    return less;
+}
+
+template <class Key>
+std::size_t NodeSearch<Key>::CountLessEqual(const Key* keys, const std::size_t count,
+                                            const Key key)
+{
+    // keys <= key is keys < key + 1 for integers, the largest key has nothing above it
+    if (key == std::numeric_limits<Key>::max())
+        return count;
+
+    return CountLess(keys, count, key + 1);
+}
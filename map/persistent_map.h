@@ -0,0 +1,83 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+/*
+ * Map whose versions share structure, so that Snapshot() is O(1).
+ *
+ * Nodes are immutable and reference counted. Insert() and Remove() copy the O(log n) nodes on the
+ * path from the root and point the copies at the untouched subtrees, then publish the new root
+ * atomically. A snapshot holds on to the root it saw and keeps that whole version alive, nothing
+ * it can reach is ever modified so reading it needs no lock and never sees a rotation half done.
+ *
+ * The tree is weight balanced (delta 3, gamma 2): the balance only needs subtree sizes, which
+ * every node keeps anyway so that Size() of any version is read off its root.
+ *
+ * Writes to one PersistentMap must come from one thread at a time, Snapshot() may be called from
+ * any thread while they run.
+ */
+template <class Key, class Value> class PersistentMap {
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        Node(const Key& key, const Value& value, NodePtr left, NodePtr right);
+
+        Key key;
+        Value value;
+        NodePtr left;
+        NodePtr right;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t kDelta = 3;
+    static constexpr std::size_t kGamma = 2;
+
+public:
+    PersistentMap();
+    PersistentMap(const PersistentMap& other);
+    PersistentMap& operator=(const PersistentMap& other);
+
+    Value At(const Key& key) const;
+    const Value* Find(const Key& key) const;
+    bool Contains(const Key& key) const;
+    void Insert(const Key& key, const Value& value);
+    void Remove(const Key& key);
+    std::size_t Size() const;
+    void Clear();
+    PersistentMap Snapshot() const;
+    template <class Function> void ForEach(Function fn) const;
+
+private:
+    NodePtr Root() const;
+    void Publish(NodePtr root);
+    NodePtr InsertInto(const NodePtr& node, const Key& key, const Value& value) const;
+    NodePtr RemoveFrom(const NodePtr& node, const Key& key, bool& removed) const;
+    inline static std::size_t SizeOf(const NodePtr& node);
+    static NodePtr RemoveMin(const NodePtr& node);
+    static NodePtr Balance(const Key& key, const Value& value, NodePtr left, NodePtr right);
+    static NodePtr MakeNode(const Key& key, const Value& value, NodePtr left, NodePtr right);
+    template <class Function> static void ForEach(const Node* node, Function& fn);
+
+private:
+    std::less<Key> m_comparator;
+    NodePtr m_root;
+};
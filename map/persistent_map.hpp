@@ -0,0 +1,265 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "persistent_map.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+template <class Key, class Value>
+PersistentMap<Key, Value>::Node::Node(const Key& key, const Value& value, NodePtr left,
+                                      NodePtr right)
+    : key(key)
+    , value(value)
+    , left(std::move(left))
+    , right(std::move(right))
+    , size(1 + SizeOf(this->left) + SizeOf(this->right))
+{
+}
+
+template <class Key, class Value>
+PersistentMap<Key, Value>::PersistentMap()
+    : m_comparator()
+    , m_root(nullptr)
+{
+}
+
+template <class Key, class Value>
+PersistentMap<Key, Value>::PersistentMap(const PersistentMap& other)
+    : m_comparator()
+    , m_root(other.Root())
+{
+}
+
+template <class Key, class Value>
+PersistentMap<Key, Value>& PersistentMap<Key, Value>::operator=(const PersistentMap& other)
+{
+    if (this != &other)
+        Publish(other.Root());
+
+    return *this;
+}
+
+template <class Key, class Value> Value PersistentMap<Key, Value>::At(const Key& key) const
+{
+    const Value* value = Find(key);
+
+    if (value == nullptr) {
+        if constexpr (std::is_arithmetic_v<Key>)
+            throw std::out_of_range("invalid key: " + std::to_string(key));
+        else
+            throw std::out_of_range("invalid key");
+    }
+
+    return *value;
+}
+
+template <class Key, class Value>
+const Value* PersistentMap<Key, Value>::Find(const Key& key) const
+{
+    const Node* node = m_root.get();
+
+    while (node != nullptr) {
+        if (m_comparator(key, node->key))
+            node = node->left.get();
+        else if (m_comparator(node->key, key))
+            node = node->right.get();
+        else
+            return &node->value;
+    }
+
+    return nullptr;
+}
+
+template <class Key, class Value> bool PersistentMap<Key, Value>::Contains(const Key& key) const
+{
+    return Find(key) != nullptr;
+}
+
+template <class Key, class Value>
+void PersistentMap<Key, Value>::Insert(const Key& key, const Value& value)
+{
+    Publish(InsertInto(m_root, key, value));
+}
+
+template <class Key, class Value> void PersistentMap<Key, Value>::Remove(const Key& key)
+{
+    bool removed = false;
+    NodePtr root = RemoveFrom(m_root, key, removed);
+
+    if (removed)
+        Publish(std::move(root));
+}
+
+template <class Key, class Value> std::size_t PersistentMap<Key, Value>::Size() const
+{
+    return SizeOf(m_root);
+}
+
+template <class Key, class Value> void PersistentMap<Key, Value>::Clear() { Publish(nullptr); }
+
+template <class Key, class Value>
+PersistentMap<Key, Value> PersistentMap<Key, Value>::Snapshot() const
+{
+    return PersistentMap(*this);
+}
+
+template <class Key, class Value>
+template <class Function>
+void PersistentMap<Key, Value>::ForEach(Function fn) const
+{
+    const NodePtr root = m_root;
+    ForEach(root.get(), fn);
+}
+
+// m_root is only ever replaced by the writer, the atomic access is for the snapshots other threads
+// take meanwhile
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr PersistentMap<Key, Value>::Root() const
+{
+    return std::atomic_load(&m_root);
+}
+
+template <class Key, class Value> void PersistentMap<Key, Value>::Publish(NodePtr root)
+{
+    std::atomic_store(&m_root, std::move(root));
+}
+
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr
+PersistentMap<Key, Value>::InsertInto(const NodePtr& node, const Key& key, const Value& value) const
+{
+    if (node == nullptr)
+        return MakeNode(key, value, nullptr, nullptr);
+
+    if (m_comparator(key, node->key))
+        return Balance(node->key, node->value, InsertInto(node->left, key, value), node->right);
+
+    if (m_comparator(node->key, key))
+        return Balance(node->key, node->value, node->left, InsertInto(node->right, key, value));
+
+    return MakeNode(key, value, node->left, node->right);
+}
+
+// a key that is not there leaves the path alone, so a missed Remove() copies nothing
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr
+PersistentMap<Key, Value>::RemoveFrom(const NodePtr& node, const Key& key, bool& removed) const
+{
+    if (node == nullptr)
+        return nullptr;
+
+    if (m_comparator(key, node->key)) {
+        NodePtr left = RemoveFrom(node->left, key, removed);
+        return removed ? Balance(node->key, node->value, std::move(left), node->right) : node;
+    }
+
+    if (m_comparator(node->key, key)) {
+        NodePtr right = RemoveFrom(node->right, key, removed);
+        return removed ? Balance(node->key, node->value, node->left, std::move(right)) : node;
+    }
+
+    removed = true;
+
+    if (node->left == nullptr)
+        return node->right;
+
+    if (node->right == nullptr)
+        return node->left;
+
+    const Node* successor = node->right.get();
+    while (successor->left != nullptr)
+        successor = successor->left.get();
+
+    return Balance(successor->key, successor->value, node->left, RemoveMin(node->right));
+}
+
+template <class Key, class Value>
+std::size_t PersistentMap<Key, Value>::SizeOf(const NodePtr& node)
+{
+    return (node == nullptr) ? 0 : node->size;
+}
+
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr
+PersistentMap<Key, Value>::RemoveMin(const NodePtr& node)
+{
+    if (node->left == nullptr)
+        return node->right;
+
+    return Balance(node->key, node->value, RemoveMin(node->left), node->right);
+}
+
+// one insert or remove leaves a side at most one element off balance, a single or a double
+// rotation, built from fresh nodes, fixes it
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr
+PersistentMap<Key, Value>::Balance(const Key& key, const Value& value, NodePtr left, NodePtr right)
+{
+    const std::size_t left_weight = SizeOf(left) + 1;
+    const std::size_t right_weight = SizeOf(right) + 1;
+
+    if (right_weight > kDelta * left_weight) {
+        const Node& top = *right;
+
+        if (SizeOf(top.left) + 1 < kGamma * (SizeOf(top.right) + 1))
+            return MakeNode(top.key, top.value, MakeNode(key, value, std::move(left), top.left),
+                            top.right);
+
+        const Node& inner = *top.left;
+
+        return MakeNode(inner.key, inner.value, MakeNode(key, value, std::move(left), inner.left),
+                        MakeNode(top.key, top.value, inner.right, top.right));
+    }
+
+    if (left_weight > kDelta * right_weight) {
+        const Node& top = *left;
+
+        if (SizeOf(top.right) + 1 < kGamma * (SizeOf(top.left) + 1))
+            return MakeNode(top.key, top.value, top.left,
+                            MakeNode(key, value, top.right, std::move(right)));
+
+        const Node& inner = *top.right;
+
+        return MakeNode(inner.key, inner.value, MakeNode(top.key, top.value, top.left, inner.left),
+                        MakeNode(key, value, inner.right, std::move(right)));
+    }
+
+    return MakeNode(key, value, std::move(left), std::move(right));
+}
+
+template <class Key, class Value>
+typename PersistentMap<Key, Value>::NodePtr
+PersistentMap<Key, Value>::MakeNode(const Key& key, const Value& value, NodePtr left,
+                                    NodePtr right)
+{
+    return std::make_shared<const Node>(key, value, std::move(left), std::move(right));
+}
+
+template <class Key, class Value>
+template <class Function>
+void PersistentMap<Key, Value>::ForEach(const Node* node, Function& fn)
+{
+    if (node == nullptr)
+        return;
+
+    ForEach(node->left.get(), fn);
+    fn(node->key, node->value);
+    ForEach(node->right.get(), fn);
+}
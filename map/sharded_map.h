@@ -0,0 +1,67 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "map.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+/*
+ * Thread-safe map split into Map shards by key range.
+ *
+ * Shard i holds the keys in [boundaries[i - 1], boundaries[i]), so walking the shards in order
+ * walks the keys in order. Every shard has its own std::shared_mutex: lookups take it shared and
+ * run in parallel, writers only block the one shard they touch. Scans lock one shard at a time,
+ * they see each shard consistently but not the whole map at a single point in time.
+ */
+template <class Key, class Value> class ShardedMap {
+
+    static constexpr std::size_t kCacheLine = 64;
+
+    // one line per shard at least, so that locking a shard does not bounce its neighbour's line
+    struct alignas(kCacheLine) Shard {
+        mutable std::shared_mutex mutex;
+        Map<Key, Value> map;
+    };
+
+public:
+    explicit ShardedMap(std::vector<Key> boundaries);
+    ShardedMap(const ShardedMap& other) = delete;
+    ShardedMap& operator=(const ShardedMap& other) = delete;
+
+    Value At(const Key& key) const;
+    bool Contains(const Key& key) const;
+    bool TryGet(const Key& key, Value& out) const;
+    void Insert(const Key& key, const Value& value);
+    void Remove(const Key& key);
+    std::size_t Size() const;
+    std::size_t ShardCount() const;
+    void Clear();
+    template <class Function> void ForEach(Function fn) const;
+    template <class Function>
+    void ForEachInRange(const Key& lo, const Key& hi, Function fn) const;
+
+private:
+    std::size_t ShardIndex(const Key& key) const;
+
+private:
+    std::less<Key> m_comparator;
+    std::vector<Key> m_boundaries;
+    std::unique_ptr<Shard[]> m_shards;
+};
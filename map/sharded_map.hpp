@@ -0,0 +1,141 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "map.hpp"
+#include "sharded_map.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+template <class Key, class Value>
+ShardedMap<Key, Value>::ShardedMap(std::vector<Key> boundaries)
+    : m_comparator()
+    , m_boundaries(std::move(boundaries))
+    , m_shards(nullptr)
+{
+    for (std::size_t i = 1; i < m_boundaries.size(); i++) {
+        if (!m_comparator(m_boundaries[i - 1], m_boundaries[i]))
+            throw std::invalid_argument("shard boundaries are not strictly increasing");
+    }
+
+    m_shards = std::make_unique<Shard[]>(m_boundaries.size() + 1);
+}
+
+template <class Key, class Value> Value ShardedMap<Key, Value>::At(const Key& key) const
+{
+    const Shard& shard = m_shards[ShardIndex(key)];
+    std::shared_lock lock(shard.mutex);
+
+    return shard.map.At(key);
+}
+
+template <class Key, class Value> bool ShardedMap<Key, Value>::Contains(const Key& key) const
+{
+    const Shard& shard = m_shards[ShardIndex(key)];
+    std::shared_lock lock(shard.mutex);
+
+    return shard.map.Contains(key);
+}
+
+template <class Key, class Value>
+bool ShardedMap<Key, Value>::TryGet(const Key& key, Value& out) const
+{
+    const Shard& shard = m_shards[ShardIndex(key)];
+    std::shared_lock lock(shard.mutex);
+
+    return shard.map.TryGet(key, out);
+}
+
+template <class Key, class Value>
+void ShardedMap<Key, Value>::Insert(const Key& key, const Value& value)
+{
+    Shard& shard = m_shards[ShardIndex(key)];
+    std::unique_lock lock(shard.mutex);
+
+    shard.map.Insert(key, value);
+}
+
+template <class Key, class Value> void ShardedMap<Key, Value>::Remove(const Key& key)
+{
+    Shard& shard = m_shards[ShardIndex(key)];
+    std::unique_lock lock(shard.mutex);
+
+    shard.map.Remove(key);
+}
+
+template <class Key, class Value> std::size_t ShardedMap<Key, Value>::Size() const
+{
+    std::size_t size = 0;
+
+    for (std::size_t i = 0; i < ShardCount(); i++) {
+        std::shared_lock lock(m_shards[i].mutex);
+        size += m_shards[i].map.Size();
+    }
+
+    return size;
+}
+
+template <class Key, class Value> std::size_t ShardedMap<Key, Value>::ShardCount() const
+{
+    return m_boundaries.size() + 1;
+}
+
+template <class Key, class Value> void ShardedMap<Key, Value>::Clear()
+{
+    for (std::size_t i = 0; i < ShardCount(); i++) {
+        std::unique_lock lock(m_shards[i].mutex);
+        m_shards[i].map.Clear();
+    }
+}
+
+template <class Key, class Value>
+template <class Function>
+void ShardedMap<Key, Value>::ForEach(Function fn) const
+{
+    for (std::size_t i = 0; i < ShardCount(); i++) {
+        std::shared_lock lock(m_shards[i].mutex);
+
+        for (const auto& entry : m_shards[i].map)
+            fn(entry.first, entry.second);
+    }
+}
+
+template <class Key, class Value>
+template <class Function>
+void ShardedMap<Key, Value>::ForEachInRange(const Key& lo, const Key& hi, Function fn) const
+{
+    if (!m_comparator(lo, hi))
+        return;
+
+    // hi is exclusive, so the shard that would hold it is only scanned below hi. fn goes in by
+    // reference so that state it keeps carries over from one shard to the next.
+    const std::size_t last = ShardIndex(hi);
+
+    for (std::size_t i = ShardIndex(lo); i <= last; i++) {
+        std::shared_lock lock(m_shards[i].mutex);
+        m_shards[i].map.ForEachInRange(lo, hi, std::ref(fn));
+    }
+}
+
+template <class Key, class Value>
+std::size_t ShardedMap<Key, Value>::ShardIndex(const Key& key) const
+{
+    return std::upper_bound(m_boundaries.begin(), m_boundaries.end(), key, m_comparator)
+        - m_boundaries.begin();
+}
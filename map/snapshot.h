@@ -0,0 +1,108 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Binary snapshot of a Map, written by Map::SaveBinary() and read by MappedMap.
+ *
+ * The file is a 64 byte header, the keys in increasing order, zero padding up to the next 64
+ * bytes, the values in the same order and padding again. Both arrays are raw copies of the
+ * objects, so the format is only for trivially copyable keys and values and only portable between
+ * machines with the same byte order and layout: the magic number reads differently on the other
+ * byte order, and the header records the key and value sizes. Each section has its own checksum,
+ * padding included, so that both can be written in the same pass over the map.
+ */
+struct SnapshotHeader {
+    // "MAPSNAP1" read as a little-endian word
+    static constexpr std::uint64_t kMagic = 0x3150414e5350414dULL;
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kAlignment = 64;
+
+    // size rounded up to the next section boundary
+    static constexpr std::size_t Padded(const std::size_t size)
+    {
+        return (size + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t key_size;
+    std::uint32_t value_size;
+    std::uint32_t flags;
+    std::uint64_t size;
+    std::uint64_t key_checksum;
+    std::uint64_t value_checksum;
+    std::uint8_t reserved[16];
+};
+
+static_assert(sizeof(SnapshotHeader) == SnapshotHeader::kAlignment,
+              "the keys start right after the header");
+
+// FNV-1a over 64 bit words, the sections are padded to whole words so the hash of a file does not
+// depend on how it was cut into pieces while it was written
+struct SnapshotChecksum {
+    static constexpr std::uint64_t kOffsetBasis = 0xcbf29ce484222325ULL;
+    static constexpr std::uint64_t kPrime = 0x100000001b3ULL;
+
+    static std::uint64_t Update(std::uint64_t hash, const void* data, const std::size_t size);
+};
+
+// writes the keys and the values of one in-order pass to their two sections, each through a
+// buffer of its own. The file is filename.tmp until Finish() renames it over filename, so a crash
+// while saving leaves the previous snapshot in place.
+class SnapshotWriter {
+
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    struct Section {
+        std::size_t offset;
+        std::size_t written;
+        std::size_t element_size;
+        std::uint64_t checksum;
+        std::vector<unsigned char> buffer;
+        std::size_t used;
+    };
+
+public:
+    SnapshotWriter(const std::string& filename, const std::uint64_t size,
+                   const std::uint32_t key_size, const std::uint32_t value_size);
+    SnapshotWriter(const SnapshotWriter& other) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter& other) = delete;
+    ~SnapshotWriter();
+
+    void Append(const void* key, const void* value);
+    void Finish();
+
+private:
+    void Append(Section& section, const void* data);
+    void Flush(Section& section);
+    void Close(Section& section);
+
+private:
+    std::string m_filename;
+    std::string m_temporary;
+    std::ofstream m_file;
+    SnapshotHeader m_header;
+    Section m_keys;
+    Section m_values;
+    bool m_finished;
+};
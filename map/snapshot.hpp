@@ -0,0 +1,147 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+inline std::uint64_t SnapshotChecksum::Update(std::uint64_t hash, const void* data,
+                                              const std::size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (std::size_t offset = 0; offset < size; offset += sizeof(std::uint64_t)) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, bytes + offset, std::min(sizeof(word), size - offset));
+        hash = (hash ^ word) * kPrime;
+    }
+
+    return hash;
+}
+
+inline SnapshotWriter::SnapshotWriter(const std::string& filename, const std::uint64_t size,
+                                      const std::uint32_t key_size,
+                                      const std::uint32_t value_size)
+    : m_filename(filename)
+    , m_temporary(filename + ".tmp")
+    , m_file(m_temporary, std::ios::binary | std::ios::trunc)
+    , m_header()
+    , m_keys { sizeof(SnapshotHeader), 0, key_size, SnapshotChecksum::kOffsetBasis,
+               std::vector<unsigned char>(kBufferSize), 0 }
+    , m_values { sizeof(SnapshotHeader) + SnapshotHeader::Padded(size * key_size), 0, value_size,
+                 SnapshotChecksum::kOffsetBasis, std::vector<unsigned char>(kBufferSize), 0 }
+    , m_finished(false)
+{
+    if (!m_file)
+        throw std::runtime_error("cannot write snapshot: " + m_temporary);
+
+    m_header.magic = SnapshotHeader::kMagic;
+    m_header.version = SnapshotHeader::kVersion;
+    m_header.key_size = key_size;
+    m_header.value_size = value_size;
+    m_header.size = size;
+}
+
+inline SnapshotWriter::~SnapshotWriter()
+{
+    if (!m_finished) {
+        m_file.close();
+        std::remove(m_temporary.c_str());
+    }
+}
+
+inline void SnapshotWriter::Append(const void* key, const void* value)
+{
+    Append(m_keys, key);
+    Append(m_values, value);
+}
+
+// the header goes in last, a file cut short on the way has no valid one. The data is on disk
+// before the rename, so a crash can not leave filename pointing at a file still being written.
+inline void SnapshotWriter::Finish()
+{
+    Close(m_keys);
+    Close(m_values);
+
+    m_header.key_checksum = m_keys.checksum;
+    m_header.value_checksum = m_values.checksum;
+
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.close();
+
+    const int fd = ::open(m_temporary.c_str(), O_RDONLY);
+    const bool synced = fd >= 0 && ::fsync(fd) == 0;
+
+    if (fd >= 0)
+        ::close(fd);
+
+    if (!m_file || !synced || std::rename(m_temporary.c_str(), m_filename.c_str()) != 0)
+        throw std::runtime_error("cannot write snapshot: " + m_filename);
+
+    m_finished = true;
+}
+
+inline void SnapshotWriter::Append(Section& section, const void* data)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (std::size_t offset = 0; offset < section.element_size;) {
+        const std::size_t chunk
+            = std::min(section.element_size - offset, kBufferSize - section.used);
+        std::memcpy(section.buffer.data() + section.used, bytes + offset, chunk);
+        section.used += chunk;
+        offset += chunk;
+
+        if (section.used == kBufferSize)
+            Flush(section);
+    }
+}
+
+// the buffer is flushed when full or by Close(), both leave it a whole number of words
+inline void SnapshotWriter::Flush(Section& section)
+{
+    section.checksum
+        = SnapshotChecksum::Update(section.checksum, section.buffer.data(), section.used);
+
+    m_file.seekp(static_cast<std::streamoff>(section.offset + section.written));
+    m_file.write(reinterpret_cast<const char*>(section.buffer.data()),
+                 static_cast<std::streamsize>(section.used));
+    section.written += section.used;
+    section.used = 0;
+
+    if (!m_file)
+        throw std::runtime_error("cannot write snapshot: " + m_temporary);
+}
+
+inline void SnapshotWriter::Close(Section& section)
+{
+    const std::size_t end = section.written + section.used;
+
+    for (std::size_t padding = SnapshotHeader::Padded(end) - end; padding > 0; padding--) {
+        section.buffer[section.used++] = 0;
+
+        if (section.used == kBufferSize)
+            Flush(section);
+    }
+
+    Flush(section);
+}
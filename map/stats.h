@@ -0,0 +1,124 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Stats policies count the work Map does, for finding out what a slow operation spent its time
+ * on.
+ *
+ * A policy has a static Count(counter, n) that Map calls for the events below and a static
+ * Path(operation, length) it calls with the number of nodes every lookup, insert and remove
+ * descended through. kEnabled tells Map whether to measure the path lengths at all. NoStats, the
+ * default, has empty hooks and kEnabled false, so a Map without stats compiles to the same code
+ * as before they existed.
+ */
+
+enum class MapCounter {
+    COMPARISONS = 0,
+    ROTATIONS,
+    RECOLORS,
+    INSERT_FIXUPS,
+    REMOVE_FIXUPS,
+    ALLOCATIONS,
+};
+
+enum class MapOperation { LOOKUP = 0, INSERT, REMOVE };
+
+// the counters and the path length histograms of every operation, added up over threads
+struct MapStats {
+    static constexpr std::size_t kCounters = 6;
+    static constexpr std::size_t kOperations = 3;
+    // a red-black tree of 2^32 nodes is at most 64 deep, longer paths share the last bucket
+    static constexpr std::size_t kPathBuckets = 65;
+
+    std::array<std::uint64_t, kCounters> counters {};
+    std::array<std::array<std::uint64_t, kPathBuckets>, kOperations> paths {};
+
+    std::uint64_t Get(const MapCounter counter) const;
+    std::uint64_t Operations(const MapOperation operation) const;
+    double MeanPath(const MapOperation operation) const;
+    std::size_t LongestPath(const MapOperation operation) const;
+    // flat name -> value pairs, e.g. "rotations" or "insert.longest_path", for exporting
+    std::map<std::string, std::uint64_t> Export() const;
+
+    static const char* Name(const MapCounter counter);
+    static const char* Name(const MapOperation operation);
+};
+
+struct NoStats {
+    static constexpr bool kEnabled = false;
+
+    static void Count(const MapCounter /* counter */, const std::uint64_t /* n */ = 1) { }
+    static void Path(const MapOperation /* operation */, const std::size_t /* length */) { }
+};
+
+/*
+ * Counts into per-thread slots, so that threads working on different maps never share a cache
+ * line, and adds the slots up in Snapshot(). Every map using ThreadLocalStats<Tag> counts into
+ * the same totals, maps that should be told apart get a Tag each.
+ *
+ * A slot is only written by its own thread, with plain relaxed loads and stores rather than
+ * read-modify-writes. Snapshot() may run at any time and sees each counter either before or
+ * after an update. Reset() does not touch the slots, it remembers the current totals and
+ * Snapshot() subtracts them.
+ */
+template <class Tag = void> class ThreadLocalStats {
+
+    struct Slot {
+        Slot();
+        Slot(const Slot& other) = delete;
+        Slot& operator=(const Slot& other) = delete;
+        ~Slot();
+
+        void AddTo(MapStats& stats) const;
+
+        std::array<std::atomic<std::uint64_t>, MapStats::kCounters> counters;
+        std::array<std::array<std::atomic<std::uint64_t>, MapStats::kPathBuckets>,
+                   MapStats::kOperations>
+            paths;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<const Slot*> slots;
+        // what the threads that have exited counted
+        MapStats retired;
+        // the totals at the last Reset()
+        MapStats baseline;
+    };
+
+public:
+    static constexpr bool kEnabled = true;
+
+    static void Count(const MapCounter counter, const std::uint64_t n = 1);
+    static void Path(const MapOperation operation, const std::size_t length);
+    static MapStats Snapshot();
+    static void Reset();
+
+private:
+    static Registry& GetRegistry();
+    static Slot& Local();
+    static MapStats Totals(Registry& registry);
+};
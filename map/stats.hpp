@@ -0,0 +1,202 @@
+/*
+ * Copyright 2023 Debby Nirwan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "stats.h"
+#include <algorithm>
+
+inline std::uint64_t MapStats::Get(const MapCounter counter) const
+{
+    return counters[static_cast<std::size_t>(counter)];
+}
+
+inline std::uint64_t MapStats::Operations(const MapOperation operation) const
+{
+    const auto& histogram = paths[static_cast<std::size_t>(operation)];
+
+    std::uint64_t operations = 0;
+    for (const std::uint64_t count : histogram)
+        operations += count;
+
+    return operations;
+}
+
+inline double MapStats::MeanPath(const MapOperation operation) const
+{
+    const auto& histogram = paths[static_cast<std::size_t>(operation)];
+
+    std::uint64_t total = 0;
+    for (std::size_t length = 0; length < kPathBuckets; length++)
+        total += histogram[length] * length;
+
+    const std::uint64_t operations = Operations(operation);
+
+    return (operations == 0) ? 0.0 : static_cast<double>(total) / operations;
+}
+
+inline std::size_t MapStats::LongestPath(const MapOperation operation) const
+{
+    const auto& histogram = paths[static_cast<std::size_t>(operation)];
+
+    for (std::size_t length = kPathBuckets; length > 0; length--) {
+        if (histogram[length - 1] != 0)
+            return length - 1;
+    }
+
+    return 0;
+}
+
+inline std::map<std::string, std::uint64_t> MapStats::Export() const
+{
+    std::map<std::string, std::uint64_t> values;
+
+    for (std::size_t i = 0; i < kCounters; i++)
+        values[Name(static_cast<MapCounter>(i))] = counters[i];
+
+    for (std::size_t i = 0; i < kOperations; i++) {
+        const MapOperation operation = static_cast<MapOperation>(i);
+        const std::string prefix = std::string(Name(operation)) + ".";
+
+        std::uint64_t total = 0;
+        for (std::size_t length = 0; length < kPathBuckets; length++)
+            total += paths[i][length] * length;
+
+        values[prefix + "operations"] = Operations(operation);
+        values[prefix + "total_path"] = total;
+        values[prefix + "longest_path"] = LongestPath(operation);
+    }
+
+    return values;
+}
+
+inline const char* MapStats::Name(const MapCounter counter)
+{
+    static const char* const names[kCounters] = { "comparisons",   "rotations",     "recolors",
+                                                  "insert_fixups", "remove_fixups", "allocations" };
+
+    return names[static_cast<std::size_t>(counter)];
+}
+
+inline const char* MapStats::Name(const MapOperation operation)
+{
+    static const char* const names[kOperations] = { "lookup", "insert", "remove" };
+
+    return names[static_cast<std::size_t>(operation)];
+}
+
+template <class Tag> ThreadLocalStats<Tag>::Slot::Slot()
+{
+    for (auto& counter : counters)
+        counter.store(0, std::memory_order_relaxed);
+
+    for (auto& histogram : paths) {
+        for (auto& count : histogram)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    registry.slots.push_back(this);
+}
+
+// the counts of an exiting thread move to the registry, Snapshot() keeps including them
+template <class Tag> ThreadLocalStats<Tag>::Slot::~Slot()
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    AddTo(registry.retired);
+    registry.slots.erase(std::find(registry.slots.begin(), registry.slots.end(), this));
+}
+
+template <class Tag> void ThreadLocalStats<Tag>::Slot::AddTo(MapStats& stats) const
+{
+    for (std::size_t i = 0; i < MapStats::kCounters; i++)
+        stats.counters[i] += counters[i].load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < MapStats::kOperations; i++) {
+        for (std::size_t length = 0; length < MapStats::kPathBuckets; length++)
+            stats.paths[i][length] += paths[i][length].load(std::memory_order_relaxed);
+    }
+}
+
+// only this thread writes the slot, so a load and a store is enough and cheaper than fetch_add
+template <class Tag>
+void ThreadLocalStats<Tag>::Count(const MapCounter counter, const std::uint64_t n)
+{
+    std::atomic<std::uint64_t>& value = Local().counters[static_cast<std::size_t>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+template <class Tag>
+void ThreadLocalStats<Tag>::Path(const MapOperation operation, const std::size_t length)
+{
+    std::atomic<std::uint64_t>& count = Local().paths[static_cast<std::size_t>(
+        operation)][std::min(length, MapStats::kPathBuckets - 1)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+template <class Tag> MapStats ThreadLocalStats<Tag>::Snapshot()
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    MapStats stats = Totals(registry);
+
+    for (std::size_t i = 0; i < MapStats::kCounters; i++)
+        stats.counters[i] -= registry.baseline.counters[i];
+
+    for (std::size_t i = 0; i < MapStats::kOperations; i++) {
+        for (std::size_t length = 0; length < MapStats::kPathBuckets; length++)
+            stats.paths[i][length] -= registry.baseline.paths[i][length];
+    }
+
+    return stats;
+}
+
+template <class Tag> void ThreadLocalStats<Tag>::Reset()
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    registry.baseline = Totals(registry);
+}
+
+// constructed before the first slot registers, so destroyed after the last one leaves
+template <class Tag>
+typename ThreadLocalStats<Tag>::Registry& ThreadLocalStats<Tag>::GetRegistry()
+{
+    static Registry registry;
+
+    return registry;
+}
+
+template <class Tag> typename ThreadLocalStats<Tag>::Slot& ThreadLocalStats<Tag>::Local()
+{
+    thread_local Slot slot;
+
+    return slot;
+}
+
+template <class Tag> MapStats ThreadLocalStats<Tag>::Totals(Registry& registry)
+{
+    MapStats stats = registry.retired;
+
+    for (const Slot* slot : registry.slots)
+        slot->AddTo(stats);
+
+    return stats;
+}
@@ -0,0 +1,303 @@
+#include "btree_map.hpp"
+#include "node_search.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// a stateful allocator: it counts what it allocates into a counter of its own
+template <class T> struct CountingAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+
+    explicit CountingAllocator(std::size_t* allocations)
+        : allocations(allocations)
+    {
+    }
+
+    template <class U>
+    CountingAllocator(const CountingAllocator<U>& other)
+        : allocations(other.allocations)
+    {
+    }
+
+    T* allocate(const std::size_t n)
+    {
+        ++*allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* pointer, const std::size_t n) { std::allocator<T>().deallocate(pointer, n); }
+
+    template <class U> bool operator==(const CountingAllocator<U>& other) const
+    {
+        return allocations == other.allocations;
+    }
+
+    template <class U> bool operator!=(const CountingAllocator<U>& other) const
+    {
+        return allocations != other.allocations;
+    }
+
+    std::size_t* allocations;
+};
+
+using CountingBTreeMap
+    = BTreeMap<int, int, 256, CountingAllocator<std::pair<const int, int>>>;
+
+}
+
+TEST(BTreeMapTests, EmptyMap)
+{
+    BTreeMap<int, int> map;
+
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_EQ(map.Height(), 0);
+    EXPECT_FALSE(map.Contains(1));
+    EXPECT_THROW(map.At(1), std::out_of_range);
+
+    map.Remove(1);
+    EXPECT_EQ(map.Size(), 0);
+}
+
+TEST(BTreeMapTests, InsertAndAt)
+{
+    BTreeMap<int, int> map;
+
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i, i * 2);
+
+    EXPECT_EQ(map.Size(), 1000);
+    EXPECT_GT(map.Height(), 1);
+
+    for (int i = 0; i < 1000; i++)
+        EXPECT_EQ(map.At(i), i * 2);
+
+    map.Insert(10, 7);
+    EXPECT_EQ(map.Size(), 1000);
+    EXPECT_EQ(map.At(10), 7);
+    EXPECT_THROW(map.At(1000), std::out_of_range);
+}
+
+TEST(BTreeMapTests, RemoveShrinksTree)
+{
+    BTreeMap<int, int> map;
+
+    for (int i = 0; i < 5000; i++)
+        map.Insert(i, i);
+
+    for (int i = 0; i < 5000; i += 2)
+        map.Remove(i);
+
+    EXPECT_EQ(map.Size(), 2500);
+
+    for (int i = 0; i < 5000; i++)
+        EXPECT_EQ(map.Contains(i), i % 2 == 1);
+
+    for (int i = 4999; i >= 0; i--)
+        map.Remove(i);
+
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_EQ(map.Height(), 0);
+
+    map.Insert(3, 3);
+    EXPECT_EQ(map.At(3), 3);
+}
+
+TEST(BTreeMapTests, RandomOperationsMatchStdMap)
+{
+    BTreeMap<int, int, 128> map;
+    std::map<int, int> reference;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> keys(0, 4000);
+
+    for (int i = 0; i < 50000; i++) {
+        const int key = keys(rng);
+
+        if (rng() % 3 == 0) {
+            map.Remove(key);
+            reference.erase(key);
+        } else {
+            map.Insert(key, i);
+            reference[key] = i;
+        }
+    }
+
+    EXPECT_EQ(map.Size(), reference.size());
+
+    for (int key = 0; key <= 4000; key++) {
+        const auto it = reference.find(key);
+        const int* value = map.Find(key);
+
+        ASSERT_EQ(value != nullptr, it != reference.end());
+
+        if (value != nullptr) {
+            EXPECT_EQ(*value, it->second);
+        }
+    }
+}
+
+TEST(BTreeMapTests, ForEachInRange)
+{
+    BTreeMap<int, int> map;
+
+    for (int i = 0; i < 1000; i += 3)
+        map.Insert(i, i);
+
+    std::vector<int> keys;
+    map.ForEachInRange(100, 200, [&keys](const int& key, const int&) { keys.push_back(key); });
+
+    std::vector<int> expected;
+    for (int i = 102; i < 200; i += 3)
+        expected.push_back(i);
+
+    EXPECT_EQ(keys, expected);
+}
+
+TEST(BTreeMapTests, CopyAndMove)
+{
+    BTreeMap<std::string, std::string> map;
+
+    for (int i = 0; i < 300; i++)
+        map.Insert(std::to_string(i), "v" + std::to_string(i));
+
+    BTreeMap<std::string, std::string> copy(map);
+    map.Remove("7");
+
+    EXPECT_EQ(copy.Size(), 300);
+    EXPECT_EQ(copy.At("7"), "v7");
+    EXPECT_FALSE(map.Contains("7"));
+
+    BTreeMap<std::string, std::string> moved(std::move(copy));
+    EXPECT_EQ(moved.Size(), 300);
+    EXPECT_EQ(copy.Size(), 0);
+
+    copy = moved;
+    EXPECT_EQ(copy.Size(), 300);
+    EXPECT_EQ(copy.At("299"), "v299");
+}
+
+TEST(BTreeMapTests, CopyIsNodeForNode)
+{
+    BTreeMap<int, int> map;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> key(0, 1 << 20);
+
+    for (int i = 0; i < 20000; i++)
+        map.Insert(key(rng), i);
+
+    // inserting the entries again in key order would leave every leaf half full
+    BTreeMap<int, int> copy(map);
+    EXPECT_EQ(copy.Size(), map.Size());
+    EXPECT_EQ(copy.Height(), map.Height());
+    EXPECT_LE(copy.MemoryUsage(), map.MemoryUsage());
+
+    std::vector<std::pair<int, int>> entries;
+    std::vector<std::pair<int, int>> copied;
+    map.ForEachInRange(0, 1 << 20, [&entries](int k, int v) { entries.emplace_back(k, v); });
+    copy.ForEachInRange(0, 1 << 20, [&copied](int k, int v) { copied.emplace_back(k, v); });
+    EXPECT_EQ(copied, entries);
+
+    copy.Insert(-1, -1);
+    EXPECT_FALSE(map.Contains(-1));
+}
+
+TEST(BTreeMapTests, CopyKeepsAllocator)
+{
+    std::size_t allocations = 0;
+    std::size_t other_allocations = 0;
+
+    CountingBTreeMap map { CountingAllocator<std::pair<const int, int>>(&allocations) };
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i, i);
+
+    // the copy allocates through the same allocator, not a default constructed one
+    const std::size_t before = allocations;
+    CountingBTreeMap copy(map);
+    EXPECT_GT(allocations, before);
+    EXPECT_EQ(copy.Size(), 1000);
+
+    // propagate_on_container_copy_assignment: the target takes the allocator of the source
+    CountingBTreeMap assigned { CountingAllocator<std::pair<const int, int>>(&other_allocations) };
+    assigned.Insert(-1, -1);
+    EXPECT_EQ(other_allocations, 1);
+
+    const std::size_t before_assign = allocations;
+    assigned = map;
+    EXPECT_GT(allocations, before_assign);
+    EXPECT_EQ(other_allocations, 1);
+    EXPECT_EQ(assigned.Size(), 1000);
+    EXPECT_EQ(assigned.At(999), 999);
+}
+
+template <class Key> void ExpectNodeSearchMatchesScalar()
+{
+    std::vector<Key> keys;
+    for (Key i = -40; i < 40; i += 3)
+        keys.push_back(i * (std::numeric_limits<Key>::max() / 64));
+
+    keys.back() = std::numeric_limits<Key>::max();
+
+    for (std::size_t count = 0; count <= keys.size(); count++) {
+        const auto first = keys.begin();
+        const auto last = keys.begin() + count;
+
+        for (std::size_t i = 0; i < count; i++) {
+            for (const Key key : { Key(keys[i] - 1), keys[i], Key(keys[i] + (i + 1 < count)) }) {
+                EXPECT_EQ(NodeSearch<Key>::CountLess(keys.data(), count, key),
+                          std::lower_bound(first, last, key) - first);
+                EXPECT_EQ(NodeSearch<Key>::CountLessEqual(keys.data(), count, key),
+                          std::upper_bound(first, last, key) - first);
+            }
+        }
+    }
+}
+
+TEST(BTreeMapTests, NodeSearchMatchesScalar)
+{
+    if constexpr (NodeSearch<std::int32_t>::kVectorized)
+        ExpectNodeSearchMatchesScalar<std::int32_t>();
+
+    if constexpr (NodeSearch<std::int64_t>::kVectorized)
+        ExpectNodeSearchMatchesScalar<std::int64_t>();
+}
+
+TEST(BTreeMapTests, IntegralKeys)
+{
+    BTreeMap<std::int64_t, int> map64;
+    BTreeMap<std::int32_t, int> map32;
+    std::map<std::int64_t, int> reference;
+    std::mt19937_64 rng(7);
+
+    for (int i = 0; i < 20000; i++) {
+        const std::int64_t key = static_cast<std::int64_t>(rng() % 10000) - 5000;
+        map64.Insert(key, i);
+        map32.Insert(static_cast<std::int32_t>(key), i);
+        reference[key] = i;
+    }
+
+    map64.Insert(std::numeric_limits<std::int64_t>::max(), 1);
+    map64.Insert(std::numeric_limits<std::int64_t>::min(), 2);
+
+    EXPECT_EQ(map64.At(std::numeric_limits<std::int64_t>::max()), 1);
+    EXPECT_EQ(map64.At(std::numeric_limits<std::int64_t>::min()), 2);
+
+    for (const auto& [key, value] : reference) {
+        EXPECT_EQ(map64.At(key), value);
+        EXPECT_EQ(map32.At(static_cast<std::int32_t>(key)), value);
+    }
+
+    EXPECT_EQ(map32.Size(), reference.size());
+    EXPECT_FALSE(map32.Contains(6000));
+}
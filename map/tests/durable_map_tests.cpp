@@ -0,0 +1,133 @@
+#include "durable_map.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// a fresh directory per test, removed again when the test is done
+class DurableMapTests : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        m_directory = std::string("durable_map_tests_")
+            + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::filesystem::remove_all(m_directory);
+        std::filesystem::create_directory(m_directory);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(m_directory); }
+
+    std::string m_directory;
+};
+
+}
+
+TEST_F(DurableMapTests, RecoversFromLog)
+{
+    {
+        DurableMap<int, double> map(m_directory, DurabilityOptions { 1, 0 });
+
+        for (int i = 0; i < 1000; i++)
+            map.Insert(i, i * 0.5);
+
+        for (int i = 0; i < 1000; i += 3)
+            map.Remove(i);
+
+        map.Insert(3, -1.0);
+    }
+
+    DurableMap<int, double> map(m_directory);
+
+    EXPECT_EQ(map.Size(), 1000 - 334 + 1);
+    EXPECT_EQ(map.At(3), -1.0);
+    EXPECT_EQ(map.At(5), 2.5);
+    EXPECT_FALSE(map.Contains(6));
+    EXPECT_THROW((DurableMap<long, double>(m_directory)), std::runtime_error);
+    EXPECT_THROW((DurableMap<int, double>(m_directory, DurabilityOptions { 0, 0 })),
+                 std::invalid_argument);
+}
+
+TEST_F(DurableMapTests, RecoversFromCheckpointAndLog)
+{
+    std::map<int, int> expected;
+    std::mt19937 rng(21);
+
+    {
+        DurableMap<int, int> map(m_directory, DurabilityOptions { 100, 5000 });
+
+        for (int i = 0; i < 23456; i++) {
+            const int key = static_cast<int>(rng() % 3000);
+
+            if (rng() % 4 == 0) {
+                map.Remove(key);
+                expected.erase(key);
+            } else {
+                map.Insert(key, i);
+                expected[key] = i;
+            }
+        }
+    }
+
+    EXPECT_TRUE(std::filesystem::exists(m_directory + "/snapshot.bin"));
+
+    DurableMap<int, int> map(m_directory);
+    ASSERT_EQ(map.Size(), expected.size());
+
+    for (const auto& [key, value] : expected)
+        EXPECT_EQ(map.At(key), value);
+}
+
+TEST_F(DurableMapTests, DropsTornTail)
+{
+    {
+        DurableMap<int, int> map(m_directory, DurabilityOptions { 1, 0 });
+
+        for (int i = 0; i < 100; i++)
+            map.Insert(i, i);
+    }
+
+    // half of the last record, as if the crash came in the middle of writing it
+    const std::string log = m_directory + "/wal.log";
+    std::filesystem::resize_file(log, std::filesystem::file_size(log) - 8);
+
+    {
+        DurableMap<int, int> map(m_directory);
+        EXPECT_EQ(map.Size(), 99);
+        EXPECT_FALSE(map.Contains(99));
+
+        map.Insert(1000, 1);
+    }
+
+    {
+        std::ofstream file(log, std::ios::binary | std::ios::app);
+        file << "not a record at all";
+    }
+
+    DurableMap<int, int> map(m_directory);
+    EXPECT_EQ(map.Size(), 100);
+    EXPECT_EQ(map.At(1000), 1);
+}
+
+TEST_F(DurableMapTests, RejectsLogOfOtherTypes)
+{
+    {
+        DurableMap<int, int> map(m_directory);
+        map.Insert(1, 1);
+    }
+
+    const auto open_files = []() {
+        const std::filesystem::directory_iterator fds("/proc/self/fd");
+        return std::distance(std::filesystem::begin(fds), std::filesystem::end(fds));
+    };
+
+    // the log the constructor opened is closed again when it throws
+    const auto before = open_files();
+    EXPECT_THROW((DurableMap<long, int>(m_directory)), std::runtime_error);
+    EXPECT_EQ(open_files(), before);
+}
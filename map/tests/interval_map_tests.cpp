@@ -0,0 +1,126 @@
+#include "interval_map.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+using Found = std::vector<std::tuple<int, int, int>>;
+
+TEST(IntervalMapTests, EmptyMap)
+{
+    IntervalMap<int, int> map;
+    Found found;
+
+    map.Overlapping(5, [&found](int start, int end, int value) {
+        found.emplace_back(start, end, value);
+    });
+
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_FALSE(map.Contains(1, 2));
+    EXPECT_EQ(map.Find(1, 2), nullptr);
+    EXPECT_TRUE(found.empty());
+    EXPECT_THROW(map.Insert(3, 3, 0), std::invalid_argument);
+    EXPECT_THROW(map.Insert(4, 3, 0), std::invalid_argument);
+}
+
+TEST(IntervalMapTests, HalfOpenBounds)
+{
+    IntervalMap<int, int> map;
+    map.Insert(10, 20, 1);
+    map.Insert(10, 15, 2);
+    map.Insert(20, 30, 3);
+    map.Insert(0, 5, 4);
+    map.Insert(10, 20, 5);
+
+    EXPECT_EQ(map.Size(), 4);
+    EXPECT_EQ(*map.Find(10, 20), 5);
+
+    Found found;
+    auto collect = [&found](int start, int end, int value) {
+        found.emplace_back(start, end, value);
+    };
+
+    map.Overlapping(20, collect);
+    EXPECT_EQ(found, (Found { { 20, 30, 3 } }));
+
+    found.clear();
+    map.Overlapping(10, collect);
+    EXPECT_EQ(found, (Found { { 10, 15, 2 }, { 10, 20, 5 } }));
+
+    found.clear();
+    map.Overlapping(5, 10, collect);
+    EXPECT_TRUE(found.empty());
+
+    found.clear();
+    map.Overlapping(4, 11, collect);
+    EXPECT_EQ(found, (Found { { 0, 5, 4 }, { 10, 15, 2 }, { 10, 20, 5 } }));
+
+    found.clear();
+    map.Overlapping(12, 12, collect);
+    EXPECT_TRUE(found.empty());
+
+    map.Remove(10, 15);
+    map.Remove(10, 16);
+
+    found.clear();
+    map.Overlapping(14, 21, collect);
+    EXPECT_EQ(found, (Found { { 10, 20, 5 }, { 20, 30, 3 } }));
+}
+
+TEST(IntervalMapTests, RandomOperationsMatchLinearScan)
+{
+    IntervalMap<int, int> map;
+    std::vector<std::tuple<int, int, int>> intervals;
+    std::mt19937 rng(19);
+
+    for (int i = 0; i < 4000; i++) {
+        const int start = static_cast<int>(rng() % 10000);
+        const int end = start + 1 + static_cast<int>(rng() % ((i % 10 == 0) ? 2000 : 50));
+
+        if (map.Contains(start, end))
+            continue;
+
+        map.Insert(start, end, i);
+        intervals.emplace_back(start, end, i);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        const std::size_t index = rng() % intervals.size();
+        map.Remove(std::get<0>(intervals[index]), std::get<1>(intervals[index]));
+        intervals.erase(intervals.begin() + index);
+    }
+
+    std::sort(intervals.begin(), intervals.end());
+    ASSERT_EQ(map.Size(), intervals.size());
+
+    for (int i = 0; i < 500; i++) {
+        const int lo = static_cast<int>(rng() % 11000) - 500;
+        const int hi = lo + 1 + static_cast<int>(rng() % 300);
+
+        Found expected;
+        for (const auto& interval : intervals) {
+            if (std::get<0>(interval) < hi && lo < std::get<1>(interval))
+                expected.push_back(interval);
+        }
+
+        Found found;
+        map.Overlapping(lo, hi, [&found](int start, int end, int value) {
+            found.emplace_back(start, end, value);
+        });
+        EXPECT_EQ(found, expected);
+
+        expected.clear();
+        for (const auto& interval : intervals) {
+            if (std::get<0>(interval) <= lo && lo < std::get<1>(interval))
+                expected.push_back(interval);
+        }
+
+        found.clear();
+        map.Overlapping(lo, [&found](int start, int end, int value) {
+            found.emplace_back(start, end, value);
+        });
+        EXPECT_EQ(found, expected);
+    }
+}
@@ -0,0 +1,108 @@
+#include "latency_histogram.hpp"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+
+TEST(LatencyHistogramTests, Empty)
+{
+    LatencyHistogram histogram;
+
+    EXPECT_EQ(histogram.Count(), 0);
+    EXPECT_EQ(histogram.Min(), 0);
+    EXPECT_EQ(histogram.Max(), 0);
+    EXPECT_EQ(histogram.Mean(), 0.0);
+    EXPECT_EQ(histogram.Percentile(50), 0);
+    EXPECT_EQ(histogram.Percentile(100), 0);
+    EXPECT_TRUE(histogram.Buckets().empty());
+}
+
+TEST(LatencyHistogramTests, SmallValuesAreExact)
+{
+    LatencyHistogram histogram;
+
+    for (std::uint64_t value = 0; value < 128; value++)
+        histogram.Record(value);
+
+    const auto buckets = histogram.Buckets();
+
+    // one bucket per value below 64, from there on two values share one
+    ASSERT_EQ(buckets.size(), 64 + 32);
+    for (std::uint64_t value = 0; value < 64; value++) {
+        EXPECT_EQ(buckets[value].first, value);
+        EXPECT_EQ(buckets[value].second, 1);
+    }
+    EXPECT_EQ(buckets[64].first, 65);
+    EXPECT_EQ(buckets[64].second, 2);
+}
+
+TEST(LatencyHistogramTests, PowerOfTwoStartsABucket)
+{
+    for (int bit = 6; bit < 64; bit++) {
+        const std::uint64_t power = std::uint64_t(1) << bit;
+
+        LatencyHistogram histogram;
+        histogram.Record(power - 1);
+        histogram.Record(power);
+
+        const auto buckets = histogram.Buckets();
+        ASSERT_EQ(buckets.size(), 2) << "2^" << bit;
+        EXPECT_EQ(buckets[0].first, power - 1) << "2^" << bit;
+        EXPECT_EQ(buckets[1].first, power + (power >> 5) - 1) << "2^" << bit;
+    }
+
+    LatencyHistogram histogram;
+    histogram.Record(std::numeric_limits<std::uint64_t>::max());
+
+    ASSERT_EQ(histogram.Buckets().size(), 1);
+    EXPECT_EQ(histogram.Buckets()[0].first, std::numeric_limits<std::uint64_t>::max());
+    EXPECT_EQ(histogram.Percentile(99.9), std::numeric_limits<std::uint64_t>::max());
+}
+
+TEST(LatencyHistogramTests, RelativeError)
+{
+    std::mt19937_64 rng(5);
+
+    for (int i = 0; i < 100000; i++) {
+        // spread over every magnitude rather than crowded at the top
+        const std::uint64_t value = rng() >> (rng() % 64);
+
+        LatencyHistogram histogram;
+        histogram.Record(value);
+
+        const std::uint64_t upper = histogram.Buckets()[0].first;
+        ASSERT_GE(upper, value);
+        ASSERT_LE(upper - value, value / 32) << value;
+    }
+}
+
+TEST(LatencyHistogramTests, Percentiles)
+{
+    LatencyHistogram histogram;
+
+    for (std::uint64_t value = 1; value <= 50; value++)
+        histogram.Record(value);
+
+    EXPECT_EQ(histogram.Count(), 50);
+    EXPECT_EQ(histogram.Min(), 1);
+    EXPECT_EQ(histogram.Max(), 50);
+    EXPECT_DOUBLE_EQ(histogram.Mean(), 25.5);
+    EXPECT_EQ(histogram.Percentile(0), 1);
+    EXPECT_EQ(histogram.Percentile(50), 25);
+    EXPECT_EQ(histogram.Percentile(90), 45);
+    EXPECT_EQ(histogram.Percentile(99), 50);
+    EXPECT_EQ(histogram.Percentile(100), 50);
+
+    // a tail of one in a thousand, p99.9 still falls below it and max is the value itself
+    histogram.Clear();
+    for (int i = 0; i < 999; i++)
+        histogram.Record(63);
+    histogram.Record(5000);
+
+    EXPECT_EQ(histogram.Percentile(50), 63);
+    EXPECT_EQ(histogram.Percentile(99), 63);
+    EXPECT_EQ(histogram.Percentile(99.9), 63);
+    EXPECT_EQ(histogram.Percentile(99.95), 5000);
+    EXPECT_EQ(histogram.Max(), 5000);
+    EXPECT_EQ(histogram.Min(), 63);
+}
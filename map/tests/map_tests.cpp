@@ -1,7 +1,62 @@
 #include "map.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+namespace {
+
+// a stateful allocator: it counts what it allocates into a counter of its own
+template <class T> struct CountingAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+
+    explicit CountingAllocator(std::size_t* allocations)
+        : allocations(allocations)
+    {
+    }
+
+    template <class U>
+    CountingAllocator(const CountingAllocator<U>& other)
+        : allocations(other.allocations)
+    {
+    }
+
+    T* allocate(const std::size_t n)
+    {
+        ++*allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* pointer, const std::size_t n) { std::allocator<T>().deallocate(pointer, n); }
+
+    template <class U> bool operator==(const CountingAllocator<U>& other) const
+    {
+        return allocations == other.allocations;
+    }
+
+    template <class U> bool operator!=(const CountingAllocator<U>& other) const
+    {
+        return allocations != other.allocations;
+    }
+
+    std::size_t* allocations;
+};
+
+using CountingMap = Map<int, int, CountingAllocator<std::pair<const int, int>>>;
+
+}
 
 TEST(MapTests, EmptyMap)
 {
@@ -87,6 +142,34 @@ TEST(MapTests, MoveAssignMap)
     EXPECT_EQ(map.Size(), 0);
 }
 
+TEST(MapTests, CopyKeepsAllocator)
+{
+    std::size_t allocations = 0;
+    std::size_t other_allocations = 0;
+
+    CountingMap map { CountingAllocator<std::pair<const int, int>>(&allocations) };
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i, i);
+
+    // the copy allocates through the same allocator, not a default constructed one
+    const std::size_t before = allocations;
+    CountingMap copy(map);
+    EXPECT_GT(allocations, before);
+    EXPECT_EQ(copy.Size(), 1000);
+
+    // propagate_on_container_copy_assignment: the target takes the allocator of the source
+    CountingMap assigned { CountingAllocator<std::pair<const int, int>>(&other_allocations) };
+    assigned.Insert(-1, -1);
+    EXPECT_EQ(other_allocations, 1);
+
+    const std::size_t before_assign = allocations;
+    assigned = map;
+    EXPECT_GT(allocations, before_assign);
+    EXPECT_EQ(other_allocations, 1);
+    EXPECT_EQ(assigned.Size(), 1000);
+    EXPECT_EQ(assigned.At(999), 999);
+}
+
 TEST(MapTests, NonEmptyMap)
 {
     Map<int, int> map;
@@ -317,6 +400,1026 @@ TEST(MapTests, RemoveScenario8)
     EXPECT_EQ(map.Size(), 10);
 }
 
+TEST(MapTests, ReserveMap)
+{
+    Map<int, int> map;
+
+    map.Reserve(100);
+    for (int i = 1; i <= 100; i++)
+        map.Insert(i, i);
+
+    EXPECT_EQ(map.Size(), 100);
+    EXPECT_EQ(map.At(42), 42);
+}
+
+TEST(MapTests, ClearMap)
+{
+    Map<int, std::string> map;
+
+    for (int i = 1; i < 12; i++)
+        map.Insert(i, std::to_string(i));
+
+    map.Clear();
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_THROW(map.At(1), std::out_of_range);
+
+    map.Insert(5, "five");
+    EXPECT_EQ(map.Size(), 1);
+    EXPECT_EQ(map.At(5), "five");
+}
+
+TEST(MapTests, ReuseRemovedNodes)
+{
+    Map<int, std::string> map;
+
+    for (int i = 1; i < 100; i++)
+        map.Insert(i, std::to_string(i));
+
+    for (int i = 1; i < 100; i += 2)
+        map.Remove(i);
+
+    for (int i = 1; i < 100; i += 2)
+        map.Insert(i, std::to_string(i * 2));
+
+    EXPECT_EQ(map.Size(), 99);
+    EXPECT_EQ(map.At(3), "6");
+    EXPECT_EQ(map.At(4), "4");
+}
+
+TEST(MapTests, NodeFootprint)
+{
+    Map<int, int> map;
+    const std::size_t node_bytes = map.NodeBytes();
+
+    EXPECT_EQ(node_bytes, 2 * sizeof(int) + 3 * sizeof(void*));
+
+    std::size_t empty_usage = map.MemoryUsage();
+    map.Reserve(1000);
+    EXPECT_GE(map.MemoryUsage(), empty_usage + 1000 * node_bytes);
+}
+
+TEST(MapTests, FindAndContains)
+{
+    Map<int, int> map;
+
+    for (int i = 0; i < 20; i += 2)
+        map.Insert(i, i * 10);
+
+    const Map<int, int>& const_map = map;
+
+    ASSERT_NE(const_map.Find(4), nullptr);
+    EXPECT_EQ(*const_map.Find(4), 40);
+    EXPECT_EQ(const_map.Find(5), nullptr);
+    EXPECT_TRUE(const_map.Contains(18));
+    EXPECT_FALSE(const_map.Contains(19));
+
+    *map.Find(4) = 41;
+    EXPECT_EQ(map.At(4), 41);
+}
+
+TEST(MapTests, TryGet)
+{
+    Map<int, int> map;
+    int value = -1;
+
+    EXPECT_FALSE(map.TryGet(1, value));
+    EXPECT_EQ(value, -1);
+
+    map.Insert(1, 5);
+    EXPECT_TRUE(map.TryGet(1, value));
+    EXPECT_EQ(value, 5);
+}
+
+TEST(MapTests, Bounds)
+{
+    Map<int, int> map;
+
+    for (int i = 0; i < 20; i += 2)
+        map.Insert(i, i * 10);
+
+    EXPECT_EQ(map.LowerBound(4)->first, 4);
+    EXPECT_EQ(map.LowerBound(5)->first, 6);
+    EXPECT_EQ(map.LowerBound(-3)->first, 0);
+    EXPECT_EQ(map.LowerBound(19), map.end());
+    EXPECT_EQ(map.UpperBound(4)->first, 6);
+    EXPECT_EQ(map.UpperBound(5)->first, 6);
+    EXPECT_EQ(map.UpperBound(18), map.end());
+
+    auto range = map.EqualRange(8);
+    EXPECT_EQ(range.first->first, 8);
+    EXPECT_EQ(range.first->second, 80);
+    EXPECT_EQ(range.second->first, 10);
+
+    range = map.EqualRange(9);
+    EXPECT_EQ(range.first, range.second);
+}
+
+TEST(MapTests, StringKeys)
+{
+    Map<std::string, int> map;
+
+    map.Insert("b", 2);
+    map.Insert("a", 1);
+
+    EXPECT_EQ(map.At("a"), 1);
+    EXPECT_TRUE(map.Contains("b"));
+    EXPECT_THROW(map.At("c"), std::out_of_range);
+}
+
+TEST(MapTests, IterateInOrder)
+{
+    Map<int, int> map;
+    std::vector<int> keys;
+
+    for (int i = 0; i < 100; i++)
+        map.Insert((i * 37) % 100, i);
+
+    for (int i = 0; i < 100; i += 3)
+        map.Remove(i);
+
+    for (const auto& entry : map)
+        keys.push_back(entry.first);
+
+    EXPECT_EQ(keys.size(), map.Size());
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ(keys.front(), 1);
+    EXPECT_EQ(keys.back(), 98);
+}
+
+TEST(MapTests, IterateBackwards)
+{
+    Map<int, int> map;
+    std::vector<int> keys;
+
+    for (int i = 1; i < 12; i++)
+        map.Insert(i, i);
+
+    for (auto it = map.rbegin(); it != map.rend(); ++it)
+        keys.push_back(it->first);
+
+    EXPECT_EQ(keys, std::vector<int>({ 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 }));
+
+    auto it = map.end();
+    --it;
+    EXPECT_EQ(it->first, 11);
+}
+
+TEST(MapTests, IterateEmptyMap)
+{
+    const Map<int, int> map;
+
+    EXPECT_EQ(map.begin(), map.end());
+    EXPECT_EQ(map.rbegin(), map.rend());
+}
+
+TEST(MapTests, ModifyThroughIterator)
+{
+    Map<int, int> map;
+
+    for (int i = 1; i < 12; i++)
+        map.Insert(i, 1);
+
+    for (auto& entry : map)
+        entry.second = entry.first * 2;
+
+    EXPECT_EQ(map.At(7), 14);
+}
+
+TEST(MapTests, ForEachInRange)
+{
+    Map<int, int> map;
+    std::vector<int> keys;
+    int sum = 0;
+
+    for (int i = 0; i < 50; i++)
+        map.Insert(i * 2, i);
+
+    const Map<int, int>& const_map = map;
+    const_map.ForEachInRange(9, 21, [&](const int& key, const int& value) {
+        keys.push_back(key);
+        sum += value;
+    });
+
+    EXPECT_EQ(keys, std::vector<int>({ 10, 12, 14, 16, 18, 20 }));
+    EXPECT_EQ(sum, 5 + 6 + 7 + 8 + 9 + 10);
+
+    map.ForEachInRange(0, 4, [](const int&, int& value) { value = -1; });
+    EXPECT_EQ(map.At(2), -1);
+    EXPECT_EQ(map.At(4), 2);
+}
+
+TEST(MapTests, BuildFromSorted)
+{
+    std::vector<std::pair<int, int>> entries;
+    for (int i = 0; i < 1000; i++)
+        entries.push_back({ i * 2, i });
+
+    Map<int, int> map(entries.begin(), entries.end());
+
+    EXPECT_EQ(map.Size(), 1000);
+    EXPECT_EQ(map.At(500), 250);
+    EXPECT_FALSE(map.Contains(501));
+    EXPECT_LE(map.MaxDepth(), 10);
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), entries.begin(), entries.end(),
+                           [](const auto& lhs, const auto& rhs) {
+                               return lhs.first == rhs.first && lhs.second == rhs.second;
+                           }));
+
+    for (int i = 0; i < 2000; i += 4)
+        map.Remove(i);
+    for (int i = 1; i < 2000; i += 4)
+        map.Insert(i, i);
+
+    std::vector<int> keys;
+    for (const auto& entry : map)
+        keys.push_back(entry.first);
+
+    EXPECT_EQ(map.Size(), 1000);
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_LE(map.MaxDepth(), 20);
+}
+
+TEST(MapTests, BuildFromSortedReplacesContent)
+{
+    Map<int, std::string> map;
+    std::vector<std::pair<int, std::string>> entries = { { 1, "a" }, { 2, "b" }, { 3, "c" } };
+
+    map.Insert(10, "x");
+    map.BuildFromSorted(entries.begin(), entries.end(), SortedMode::ASSUME);
+
+    EXPECT_EQ(map.Size(), 3);
+    EXPECT_EQ(map.At(2), "b");
+    EXPECT_FALSE(map.Contains(10));
+
+    map.BuildFromSorted(entries.end(), entries.end());
+    EXPECT_EQ(map.Size(), 0);
+}
+
+TEST(MapTests, BuildFromUnsortedThrow)
+{
+    std::vector<std::pair<int, int>> entries = { { 1, 1 }, { 3, 3 }, { 2, 2 } };
+    std::vector<std::pair<int, int>> duplicates = { { 1, 1 }, { 1, 2 } };
+    Map<int, int> map;
+
+    EXPECT_THROW(map.BuildFromSorted(entries.begin(), entries.end()), std::invalid_argument);
+    EXPECT_THROW(map.BuildFromSorted(duplicates.begin(), duplicates.end()),
+                 std::invalid_argument);
+}
+
+TEST(MapTests, BuildParallel)
+{
+    // large enough for the sort and the build to be split between threads, with every key drawn
+    // about twice so that the last value given for it has to win
+    std::vector<std::pair<int, int>> entries;
+    std::mt19937 rng(11);
+    for (int i = 0; i < 300000; i++)
+        entries.push_back({ static_cast<int>(rng() % 150000), i });
+
+    std::map<int, int> reference;
+    for (const auto& entry : entries)
+        reference[entry.first] = entry.second;
+
+    for (const std::size_t threads : { 1, 2, 3, 8 }) {
+        Map<int, int> map;
+        map.Insert(-1, -1);
+        map.BuildParallel(entries.begin(), entries.end(), threads);
+
+        EXPECT_EQ(map.Size(), reference.size());
+        EXPECT_LE(map.MaxDepth(), 2 * 18);
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), reference.begin(), reference.end()));
+
+        // the nodes built by the other threads are owned by the map like any other
+        for (const auto& entry : reference)
+            map.Remove(entry.first);
+        map.Insert(1, 1);
+
+        EXPECT_EQ(map.Size(), 1);
+    }
+
+    Map<int, std::string> small;
+    const std::vector<std::pair<int, std::string>> words
+        = { { 3, "c" }, { 1, "a" }, { 3, "C" }, { 2, "b" } };
+    small.BuildParallel(words.begin(), words.end(), 4);
+
+    EXPECT_EQ(small.Size(), 3);
+    EXPECT_EQ(small.At(3), "C");
+
+    small.BuildParallel(words.end(), words.end());
+    EXPECT_EQ(small.Size(), 0);
+}
+
+TEST(MapTests, SetOperations)
+{
+    const auto sum = [](const int ours, const int theirs) { return ours + theirs; };
+    std::mt19937 rng(5);
+
+    // a small map against a large one and the other way round, large enough together for the
+    // work to be split between threads
+    for (const auto& [size, other_size] : { std::pair { 100, 60000 }, std::pair { 60000, 100 },
+                                            std::pair { 40000, 40000 } }) {
+        Map<int, int> base;
+        Map<int, int> delta;
+        std::map<int, int> base_reference;
+        std::map<int, int> delta_reference;
+
+        for (int i = 0; i < size; i++) {
+            const int key = static_cast<int>(rng() % 100000);
+            base.Insert(key, i);
+            base_reference[key] = i;
+        }
+
+        for (int i = 0; i < other_size; i++) {
+            const int key = static_cast<int>(rng() % 100000);
+            delta.Insert(key, -i);
+            delta_reference[key] = -i;
+        }
+
+        for (const std::size_t threads : { 1, 4 }) {
+            std::map<int, int> reference = base_reference;
+            for (const auto& [key, value] : delta_reference)
+                reference[key] = base_reference.count(key) ? base_reference.at(key) + value : value;
+
+            Map<int, int> united = base;
+            united.Union(Map<int, int>(delta), sum, threads);
+
+            EXPECT_EQ(united.Size(), reference.size());
+            EXPECT_TRUE(
+                std::equal(united.begin(), united.end(), reference.begin(), reference.end()));
+            EXPECT_LE(united.MaxDepth(), 2 * 17);
+
+            reference.clear();
+            for (const auto& [key, value] : base_reference) {
+                if (delta_reference.count(key))
+                    reference[key] = delta_reference.at(key);
+            }
+
+            Map<int, int> common = base;
+            common.Intersection(delta, Map<int, int>::KeepTheirs(), threads);
+
+            EXPECT_EQ(common.Size(), reference.size());
+            EXPECT_TRUE(
+                std::equal(common.begin(), common.end(), reference.begin(), reference.end()));
+
+            reference = base_reference;
+            for (const auto& entry : delta_reference)
+                reference.erase(entry.first);
+
+            Map<int, int> rest = base;
+            rest.Difference(delta, threads);
+
+            EXPECT_EQ(rest.Size(), reference.size());
+            EXPECT_TRUE(std::equal(rest.begin(), rest.end(), reference.begin(), reference.end()));
+
+            // the trees left behind are ordinary red-black trees again
+            for (int key = 0; key < 100000; key += 7) {
+                united.Remove(key);
+                common.Insert(key, key);
+                rest.Remove(key + 1);
+            }
+
+            EXPECT_LE(united.MaxDepth(), 2 * 17);
+            EXPECT_LE(common.MaxDepth(), 2 * 17);
+            EXPECT_LE(rest.MaxDepth(), 2 * 17);
+        }
+    }
+}
+
+TEST(MapTests, SetOperationsEmpty)
+{
+    Map<int, std::string> map;
+    Map<int, std::string> other;
+    other.Insert(1, "a");
+
+    map.Union(std::move(other));
+    EXPECT_EQ(map.Size(), 1);
+    EXPECT_EQ(map.At(1), "a");
+    EXPECT_EQ(other.Size(), 0);
+
+    map.Intersection(Map<int, std::string>());
+    EXPECT_EQ(map.Size(), 0);
+
+    map.Insert(2, "b");
+    map.Difference(map);
+    EXPECT_EQ(map.Size(), 0);
+}
+
+TEST(MapTests, OrderStatistics)
+{
+    OrderStatisticsMap<int, int> map;
+    std::map<int, int> reference;
+    std::mt19937 rng(17);
+
+    for (int i = 0; i < 20000; i++) {
+        const int key = static_cast<int>(rng() % 5000);
+
+        if (rng() % 3 == 0) {
+            map.Remove(key);
+            reference.erase(key);
+        } else {
+            map.Insert(key, i);
+            reference[key] = i;
+        }
+    }
+
+    std::size_t index = 0;
+    for (const auto& entry : reference) {
+        EXPECT_EQ(map.Rank(entry.first), index);
+        EXPECT_EQ(map.Select(index)->first, entry.first);
+        index++;
+    }
+
+    EXPECT_EQ(map.Select(map.Size()), map.end());
+    EXPECT_EQ(map.Rank(-1), 0);
+    EXPECT_EQ(map.Rank(5000), map.Size());
+
+    for (int lo = -10; lo < 5010; lo += 97) {
+        const int hi = lo + 250;
+        const auto count = std::distance(reference.lower_bound(lo), reference.lower_bound(hi));
+        EXPECT_EQ(map.CountRange(lo, hi), static_cast<std::size_t>(count));
+        EXPECT_EQ(map.CountRange(hi, lo), 0);
+    }
+
+    // the sizes travel with copies and are rebuilt by bulk construction
+    const OrderStatisticsMap<int, int> copy(map);
+    EXPECT_EQ(copy.Select(100)->first, map.Select(100)->first);
+
+    std::vector<std::pair<int, int>> entries(reference.begin(), reference.end());
+    OrderStatisticsMap<int, int> built(entries.begin(), entries.end());
+    EXPECT_EQ(built.Rank(entries[1000].first), 1000);
+    EXPECT_EQ(built.Select(1000)->first, entries[1000].first);
+}
+
+TEST(MapTests, Aggregate)
+{
+    AggregateMap<int, double, SumMonoid<double>> sums;
+    AggregateMap<int, double, MaxMonoid<double>> maxima;
+    std::map<int, double> reference;
+    std::mt19937 rng(23);
+
+    for (int i = 0; i < 20000; i++) {
+        const int key = static_cast<int>(rng() % 3000);
+        const double value = static_cast<double>(rng() % 1000);
+
+        if (rng() % 4 == 0) {
+            sums.Remove(key);
+            maxima.Remove(key);
+            reference.erase(key);
+        } else {
+            // a good part of these overwrite a key that is already there
+            sums.Insert(key, value);
+            maxima.Insert(key, value);
+            reference[key] = value;
+        }
+    }
+
+    for (int lo = -5; lo < 3005; lo += 41) {
+        const int hi = lo + static_cast<int>(rng() % 400);
+        double sum = 0;
+        double max = std::numeric_limits<double>::lowest();
+
+        for (auto it = reference.lower_bound(lo); it != reference.lower_bound(hi); ++it) {
+            sum += it->second;
+            max = std::max(max, it->second);
+        }
+
+        EXPECT_EQ(sums.Aggregate(lo, hi), sum);
+        EXPECT_EQ(maxima.Aggregate(lo, hi), max);
+    }
+
+    EXPECT_EQ(sums.Aggregate(10, 10), 0);
+    EXPECT_EQ(maxima.Aggregate(3000, 4000), std::numeric_limits<double>::lowest());
+}
+
+TEST(MapTests, AggregateKeepsOrder)
+{
+    struct Concat {
+        using value_type = std::string;
+
+        static std::string Identity() { return ""; }
+        static std::string Combine(const std::string& lhs, const std::string& rhs)
+        {
+            return lhs + rhs;
+        }
+    };
+
+    AggregateMap<int, std::string, Concat> map;
+    const std::string letters = "abcdefghijklmnopqrstuvwxyz";
+
+    for (const int i : { 13, 2, 25, 7, 0, 19, 4, 22, 10, 16, 1, 8, 24, 3, 11, 5, 17, 6, 20, 9, 12,
+                         14, 18, 15, 21, 23 })
+        map.Insert(i, letters.substr(i, 1));
+
+    EXPECT_EQ(map.Aggregate(0, 26), letters);
+    EXPECT_EQ(map.Aggregate(3, 9), "defghi");
+
+    map.Insert(5, "F");
+    EXPECT_EQ(map.Aggregate(3, 9), "deFghi");
+}
+
+TEST(MapTests, Stats)
+{
+    // a tag of its own, so that no other test counts into these totals
+    struct Tag {
+    };
+    using Stats = ThreadLocalStats<Tag>;
+    using CountingMap
+        = Map<int, int, std::allocator<std::pair<const int, int>>, NoAugmentation, Stats>;
+
+    CountingMap map;
+
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i, i);
+
+    MapStats stats = Stats::Snapshot();
+    EXPECT_EQ(stats.Get(MapCounter::ALLOCATIONS), 1000);
+    EXPECT_EQ(stats.Operations(MapOperation::INSERT), 1000);
+    EXPECT_GT(stats.Get(MapCounter::ROTATIONS), 0);
+    EXPECT_GT(stats.Get(MapCounter::INSERT_FIXUPS), 0);
+    EXPECT_LE(stats.LongestPath(MapOperation::INSERT), map.MaxDepth() + 1);
+    EXPECT_EQ(stats.Get(MapCounter::REMOVE_FIXUPS), 0);
+
+    Stats::Reset();
+    EXPECT_EQ(Stats::Snapshot().Get(MapCounter::ALLOCATIONS), 0);
+
+    // a thread that has exited still counts
+    std::thread reader([&map]() {
+        for (int i = 0; i < 2000; i++)
+            map.Contains(i);
+    });
+    reader.join();
+
+    for (int i = 0; i < 1000; i += 2)
+        map.Remove(i);
+
+    stats = Stats::Snapshot();
+    EXPECT_EQ(stats.Operations(MapOperation::LOOKUP), 2000);
+    EXPECT_EQ(stats.Operations(MapOperation::REMOVE), 500);
+    EXPECT_GT(stats.Get(MapCounter::REMOVE_FIXUPS), 0);
+    EXPECT_EQ(stats.Get(MapCounter::ALLOCATIONS), 0);
+    EXPECT_GT(stats.MeanPath(MapOperation::LOOKUP), 0.0);
+
+    const auto exported = stats.Export();
+    EXPECT_EQ(exported.at("lookup.operations"), 2000);
+    EXPECT_EQ(exported.at("comparisons"), stats.Get(MapCounter::COMPARISONS));
+
+    // a parallel build counts the nodes each thread creates, the middle ones too
+    std::vector<std::pair<int, int>> entries;
+    for (int i = 0; i < 100000; i++)
+        entries.push_back({ i, i });
+
+    Stats::Reset();
+    CountingMap built;
+    built.BuildParallel(entries.begin(), entries.end(), 4);
+    EXPECT_EQ(Stats::Snapshot().Get(MapCounter::ALLOCATIONS), built.Size());
+}
+
+TEST(MapTests, CopyKeepsShape)
+{
+    Map<int, std::string> map;
+
+    for (int i = 0; i < 200; i++)
+        map.Insert((i * 89) % 200, std::to_string(i));
+
+    for (int i = 0; i < 200; i += 7)
+        map.Remove(i);
+
+    Map<int, std::string> map2(map);
+
+    EXPECT_EQ(map2.Size(), map.Size());
+    EXPECT_EQ(map2.MaxDepth(), map.MaxDepth());
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), map2.begin(), map2.end()));
+
+    map2.Insert(7, "seven");
+    map2.Remove(1);
+    EXPECT_FALSE(map.Contains(7));
+    EXPECT_TRUE(map.Contains(1));
+}
+
+TEST(MapTests, Emplace)
+{
+    Map<int, std::string> map;
+
+    auto result = map.Emplace(1, "one");
+    EXPECT_TRUE(result.second);
+    EXPECT_EQ(result.first->second, "one");
+
+    result = map.Emplace(1, "uno");
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ(result.first->second, "one");
+    EXPECT_EQ(map.Size(), 1);
+}
+
+TEST(MapTests, TryEmplace)
+{
+    Map<int, std::string> map;
+
+    EXPECT_TRUE(map.TryEmplace(1, 3, 'a').second);
+    EXPECT_EQ(map.At(1), "aaa");
+
+    auto result = map.TryEmplace(1, 5, 'b');
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ(result.first->second, "aaa");
+}
+
+TEST(MapTests, InsertOrAssign)
+{
+    Map<std::string, std::string> map;
+    std::string key = "key";
+
+    EXPECT_TRUE(map.InsertOrAssign(key, "first").second);
+    EXPECT_FALSE(map.InsertOrAssign(std::move(key), "second").second);
+    EXPECT_EQ(map.At("key"), "second");
+    EXPECT_EQ(map.Size(), 1);
+}
+
+TEST(MapTests, MoveOnlyValues)
+{
+    Map<int, std::unique_ptr<int>> map;
+
+    map.TryEmplace(1, std::make_unique<int>(10));
+    map.InsertOrAssign(2, std::make_unique<int>(20));
+    map.Emplace(3, std::make_unique<int>(30));
+    map.InsertOrAssign(1, std::make_unique<int>(11));
+
+    EXPECT_EQ(map.Size(), 3);
+    EXPECT_EQ(**map.Find(1), 11);
+    EXPECT_EQ(**map.Find(3), 30);
+}
+
+TEST(MapTests, ExtractAndInsertNode)
+{
+    Map<int, std::string> map;
+    Map<int, std::string> map2;
+
+    map.Insert(1, "one");
+    map.Insert(2, "two");
+
+    auto node = map.Extract(1);
+    EXPECT_FALSE(node.Empty());
+    EXPECT_EQ(node.GetKey(), 1);
+    EXPECT_EQ(node.GetValue(), "one");
+    EXPECT_EQ(map.Size(), 1);
+    EXPECT_FALSE(map.Contains(1));
+
+    auto result = map2.Insert(std::move(node));
+    EXPECT_TRUE(result.second);
+    EXPECT_EQ(result.first->second, "one");
+    EXPECT_TRUE(node.Empty());
+
+    EXPECT_TRUE(map.Extract(5).Empty());
+
+    map.Insert(1, "uno");
+    auto duplicate = map.Extract(1);
+    EXPECT_FALSE(map2.Insert(std::move(duplicate)).second);
+    EXPECT_FALSE(duplicate.Empty());
+    EXPECT_EQ(map2.At(1), "one");
+
+    // with allocators that compare equal the node itself moves, even after its map is gone
+    std::size_t allocations = 0;
+    CountingAllocator<std::pair<const int, int>> allocator(&allocations);
+    CountingMap target { allocator };
+    target.Insert(2, 20);
+
+    CountingMap::NodeHandle handle;
+    {
+        CountingMap source { allocator };
+        source.Insert(1, 10);
+        handle = source.Extract(1);
+    }
+    const int* value = &handle.GetValue();
+    const std::size_t before = allocations;
+
+    auto moved = target.Insert(std::move(handle));
+    EXPECT_TRUE(moved.second);
+    EXPECT_EQ(allocations, before);
+    EXPECT_EQ(&moved.first->second, value);
+    EXPECT_EQ(target.At(1), 10);
+    EXPECT_EQ(target.Size(), 2);
+
+    // otherwise the entry is moved into a node of the target
+    std::size_t other_allocations = 0;
+    CountingMap other { CountingAllocator<std::pair<const int, int>>(&other_allocations) };
+    auto copied = other.Insert(target.Extract(1));
+    EXPECT_TRUE(copied.second);
+    EXPECT_GT(other_allocations, 0);
+    EXPECT_EQ(other.At(1), 10);
+    EXPECT_EQ(target.Size(), 1);
+}
+
+TEST(MapTests, ExtractAndDiscardNode)
+{
+    Map<int, int> map;
+
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i, i);
+
+    // a dropped handle gives its slot back, the next insert takes it again
+    const std::size_t usage = map.MemoryUsage();
+    for (int i = 0; i < 100000; i++) {
+        map.Insert(5000, i);
+        EXPECT_FALSE(map.Extract(5000).Empty());
+    }
+    EXPECT_EQ(map.MemoryUsage(), usage);
+    EXPECT_EQ(map.Size(), 1000);
+
+    // also once the map it came from is gone
+    Map<int, int>::NodeHandle handle;
+    {
+        Map<int, int> source;
+        source.Insert(1, 1);
+        handle = source.Extract(1);
+    }
+    EXPECT_EQ(handle.GetValue(), 1);
+    handle = Map<int, int>::NodeHandle();
+    EXPECT_TRUE(handle.Empty());
+}
+
+TEST(MapTests, ExchangedNodesKeepMapsIndependent)
+{
+    Map<int, int> first;
+    Map<int, int> second;
+
+    first.Insert(-1, -1);
+    second.Insert(first.Extract(-1));
+    second.Insert(-2, -2);
+    first.Insert(second.Extract(-2));
+
+    // each map still grows its own slabs, so the two can be filled from different threads
+    std::thread writer([&first]() {
+        for (int i = 0; i < 100000; i++)
+            first.Insert(i, i);
+    });
+    for (int i = 0; i < 100000; i++)
+        second.Insert(i, -i);
+    writer.join();
+
+    EXPECT_EQ(first.Size(), 100001);
+    EXPECT_EQ(second.Size(), 100001);
+    EXPECT_EQ(first.At(-2), -2);
+    EXPECT_EQ(second.At(-1), -1);
+    EXPECT_EQ(second.At(99999), -99999);
+
+    first.Clear();
+    EXPECT_EQ(second.At(-1), -1);
+}
+
+TEST(MapTests, Freeze)
+{
+    Map<int, int> map;
+
+    for (int i = 0; i < 1000; i++)
+        map.Insert(i * 2, i);
+
+    const FrozenMap<int, int> frozen = map.Freeze();
+    map.Clear();
+
+    EXPECT_EQ(frozen.Size(), 1000);
+
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(frozen.At(i * 2), i);
+        EXPECT_FALSE(frozen.Contains(i * 2 + 1));
+    }
+
+    EXPECT_FALSE(frozen.Contains(-1));
+    EXPECT_THROW(frozen.At(2000), std::out_of_range);
+
+    int expected = 0;
+    for (const auto& [key, value] : frozen) {
+        EXPECT_EQ(key, expected * 2);
+        EXPECT_EQ(value, expected);
+        expected++;
+    }
+    EXPECT_EQ(expected, 1000);
+
+    auto it = frozen.end();
+    for (int i = 999; i >= 0; i--) {
+        --it;
+        EXPECT_EQ(it->first, i * 2);
+    }
+    EXPECT_EQ(it, frozen.begin());
+}
+
+TEST(MapTests, FreezeSmallMaps)
+{
+    Map<std::string, int> map;
+
+    const auto empty = map.Freeze();
+    EXPECT_EQ(empty.Size(), 0);
+    EXPECT_EQ(empty.begin(), empty.end());
+    EXPECT_FALSE(empty.Contains("a"));
+
+    // every size up to two full levels checks the in-order fill of partial last levels
+    for (int n = 1; n <= 9; n++) {
+        map.Insert(std::string(1, static_cast<char>('a' + n - 1)), n);
+
+        const auto frozen = map.Freeze();
+        EXPECT_EQ(frozen.Size(), n);
+        EXPECT_TRUE(std::equal(frozen.begin(), frozen.end(), map.begin(), map.end(),
+                               [](const auto& lhs, const auto& rhs) {
+                                   return lhs.first == rhs.first && lhs.second == rhs.second;
+                               }));
+
+        for (const auto& [key, value] : map)
+            EXPECT_EQ(frozen.At(key), value);
+    }
+}
+
+TEST(MapTests, SaveAndLoadBinary)
+{
+    const std::string filename = "map_tests_snapshot.bin";
+    Map<int, double> map;
+
+    for (int i = 0; i < 5000; i++)
+        map.Insert(i * 3, i * 0.5);
+
+    map.SaveBinary(filename);
+
+    Map<int, double> loaded;
+    loaded.Insert(-1, 1.0);
+    loaded.LoadBinary(filename);
+
+    EXPECT_EQ(loaded.Size(), 5000);
+    EXPECT_FALSE(loaded.Contains(-1));
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), loaded.begin(), loaded.end()));
+
+    const MappedMap<int, double> mapped(filename);
+    EXPECT_EQ(mapped.Size(), 5000);
+
+    for (int i = 0; i < 5000; i++) {
+        EXPECT_EQ(mapped.At(i * 3), i * 0.5);
+        EXPECT_FALSE(mapped.Contains(i * 3 + 1));
+    }
+
+    EXPECT_FALSE(mapped.Contains(-1));
+    EXPECT_THROW(mapped.At(15000), std::out_of_range);
+    EXPECT_EQ(std::distance(mapped.begin(), mapped.end()), 5000);
+
+    // a key of another size and a flipped byte in the values are both caught
+    EXPECT_THROW((MappedMap<long, double>(filename)), std::runtime_error);
+
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-100, std::ios::end);
+        file.put('x');
+    }
+
+    EXPECT_THROW(loaded.LoadBinary(filename), std::runtime_error);
+    EXPECT_EQ(loaded.Size(), 5000);
+    EXPECT_NO_THROW((MappedMap<int, double>(filename, ChecksumMode::SKIP)));
+
+    Map<int, double>().SaveBinary(filename);
+    loaded.LoadBinary(filename);
+    EXPECT_EQ(loaded.Size(), 0);
+
+    std::remove(filename.c_str());
+    EXPECT_THROW(loaded.LoadBinary(filename), std::runtime_error);
+}
+
+TEST(MapTests, LookupBatch)
+{
+    Map<int, std::string> map;
+
+    for (int i = 0; i < 500; i += 2)
+        map.Insert(i, std::to_string(i));
+
+    std::vector<int> keys;
+    for (int i = 0; i < 37; i++)
+        keys.push_back((i * 97) % 520);
+
+    std::vector<std::string> values(keys.size());
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+
+    const std::size_t hits = map.LookupBatch(keys.data(), keys.size(), values.data(), found.get());
+
+    std::size_t expected_hits = 0;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        const bool present = keys[i] % 2 == 0 && keys[i] < 500;
+        EXPECT_EQ(found[i], present);
+
+        if (present) {
+            EXPECT_EQ(values[i], std::to_string(keys[i]));
+            expected_hits++;
+        }
+    }
+    EXPECT_EQ(hits, expected_hits);
+
+    EXPECT_EQ(map.LookupBatch(keys.data(), 0, values.data(), found.get()), 0);
+
+    Map<int, std::string> empty;
+    EXPECT_EQ(empty.LookupBatch(keys.data(), keys.size(), values.data(), found.get()), 0);
+    EXPECT_FALSE(found[0]);
+}
+
+TEST(MapTests, ApplyBatch)
+{
+    using BatchOp = Map<int, std::string>::BatchOp;
+
+    // 10 updates against 10 entries take the rebuild path, against 1000 the update by update one
+    for (const int size : { 10, 1000 }) {
+        Map<int, std::string> map;
+        std::map<int, std::string> reference;
+
+        for (int i = 0; i < size; i++) {
+            map.Insert(i * 2, "old");
+            reference[i * 2] = "old";
+        }
+
+        std::vector<BatchOp> ops { { 7, "seven" }, { 0, std::nullopt }, { 4, "four" },
+                                   { -1, "minus" }, { 7, std::nullopt }, { 7, "again" },
+                                   { 3, std::nullopt }, { 2 * size, "last" }, { 6, std::nullopt },
+                                   { 4, "four!" } };
+
+        for (const auto& op : ops) {
+            if (op.value)
+                reference[op.key] = *op.value;
+            else
+                reference.erase(op.key);
+        }
+
+        map.ApplyBatch(ops);
+
+        EXPECT_EQ(map.Size(), reference.size());
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), reference.begin(), reference.end()));
+        EXPECT_LE(map.MaxDepth(), 2 * 11);
+    }
+}
+
+TEST(MapTests, ApplySparseBatch)
+{
+    struct Tag {
+    };
+    using Stats = ThreadLocalStats<Tag>;
+    using CountingMap
+        = Map<int, int, std::allocator<std::pair<const int, int>>, NoAugmentation, Stats>;
+    using BatchOp = CountingMap::BatchOp;
+
+    CountingMap map;
+    std::map<int, int> reference;
+    const int size = 1 << 14;
+
+    for (int i = 0; i < size; i++) {
+        map.Insert(i * 2, i);
+        reference[i * 2] = i;
+    }
+
+    // inserts, updates and removals spread over the whole tree, well under 1/8 of it
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> key(-10, 2 * size + 10);
+    std::vector<BatchOp> ops;
+    for (int i = 0; i < size / 16; i++) {
+        const int k = key(rng);
+        if (i % 3 == 0)
+            ops.push_back({ k, std::nullopt });
+        else
+            ops.push_back({ k, i });
+    }
+
+    std::vector<BatchOp> sorted = ops;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const BatchOp& lhs, const BatchOp& rhs) { return lhs.key < rhs.key; });
+    for (const auto& op : sorted) {
+        if (op.value)
+            reference[op.key] = *op.value;
+        else
+            reference.erase(op.key);
+    }
+
+    map.ApplyBatch(ops);
+
+    EXPECT_EQ(map.Size(), reference.size());
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), reference.begin(), reference.end()));
+    EXPECT_LE(map.MaxDepth(), 2 * 15);
+
+    // a run of neighbouring keys is a short climb from one to the next, far fewer comparisons
+    // than a descent from the root for each
+    std::vector<BatchOp> run;
+    for (int i = 0; i < size / 16; i++)
+        run.push_back({ 2 * size + 2 * i, i });
+
+    Stats::Reset();
+    map.ApplyBatch(run);
+
+    EXPECT_EQ(map.Size(), reference.size() + run.size());
+    EXPECT_LE(map.MaxDepth(), 2 * 15);
+    EXPECT_LT(Stats::Snapshot().Get(MapCounter::COMPARISONS), run.size() * map.MaxDepth());
+}
+
+TEST(MapTests, ApplySortedBatch)
+{
+    using BatchOp = Map<int, int>::BatchOp;
+    Map<int, int> map;
+
+    const std::vector<BatchOp> sorted { { 1, 10 }, { 2, 20 }, { 2, 21 }, { 3, std::nullopt } };
+    map.ApplySortedBatch(sorted.begin(), sorted.end());
+
+    EXPECT_EQ(map.Size(), 2);
+    EXPECT_EQ(map.At(2), 21);
+
+    const std::vector<BatchOp> unsorted { { 2, 1 }, { 1, 1 } };
+    EXPECT_THROW(map.ApplySortedBatch(unsorted.begin(), unsorted.end()), std::invalid_argument);
+    EXPECT_EQ(map.At(2), 21);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
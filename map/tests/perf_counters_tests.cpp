@@ -0,0 +1,33 @@
+#include "perf_counters.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// hardware counters are often missing in containers and virtual machines, so this only checks
+// what has to hold either way
+TEST(PerfCountersTests, ReportsOnlyAvailableEvents)
+{
+    PerfCounters counters;
+
+    std::vector<int> values(100000);
+    counters.Start();
+    for (std::size_t i = 0; i < values.size(); i++)
+        values[i] = static_cast<int>(i * 3);
+    counters.Stop();
+
+    EXPECT_TRUE(counters.PerOperation(0).empty());
+
+    const auto per_operation = counters.PerOperation(values.size());
+    for (std::size_t i = 0; i < PerfCounters::kEvents; i++) {
+        const PerfEvent event = static_cast<PerfEvent>(i);
+        EXPECT_EQ(per_operation.count(PerfCounters::Name(event)) == 1, counters.Available(event));
+    }
+
+    if (counters.Available(PerfEvent::INSTRUCTIONS)) {
+        EXPECT_GT(counters.Get(PerfEvent::INSTRUCTIONS), 0.0);
+    }
+
+    counters.Clear();
+    for (std::size_t i = 0; i < PerfCounters::kEvents; i++)
+        EXPECT_EQ(counters.Get(static_cast<PerfEvent>(i)), 0.0);
+}
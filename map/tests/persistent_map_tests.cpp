@@ -0,0 +1,106 @@
+#include "persistent_map.hpp"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(PersistentMapTests, EmptyMap)
+{
+    PersistentMap<int, int> map;
+
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_FALSE(map.Contains(1));
+    EXPECT_THROW(map.At(1), std::out_of_range);
+
+    map.Remove(1);
+    EXPECT_EQ(map.Size(), 0);
+}
+
+TEST(PersistentMapTests, RandomOperationsMatchStdMap)
+{
+    PersistentMap<int, int> map;
+    std::map<int, int> reference;
+    std::mt19937 rng(3);
+
+    for (int i = 0; i < 30000; i++) {
+        const int key = static_cast<int>(rng() % 3000);
+
+        if (rng() % 3 == 0) {
+            map.Remove(key);
+            reference.erase(key);
+        } else {
+            map.Insert(key, i);
+            reference[key] = i;
+        }
+    }
+
+    EXPECT_EQ(map.Size(), reference.size());
+
+    auto it = reference.begin();
+    map.ForEach([&it](const int& key, const int& value) {
+        EXPECT_EQ(key, it->first);
+        EXPECT_EQ(value, it->second);
+        ++it;
+    });
+    EXPECT_EQ(it, reference.end());
+}
+
+TEST(PersistentMapTests, SnapshotIsIsolated)
+{
+    PersistentMap<std::string, int> map;
+
+    for (int i = 0; i < 100; i++)
+        map.Insert(std::to_string(i), i);
+
+    const auto snapshot = map.Snapshot();
+
+    for (int i = 0; i < 100; i += 2)
+        map.Remove(std::to_string(i));
+
+    map.Insert("1", 100);
+    map.Insert("new", 7);
+
+    EXPECT_EQ(snapshot.Size(), 100);
+    EXPECT_EQ(snapshot.At("0"), 0);
+    EXPECT_EQ(snapshot.At("1"), 1);
+    EXPECT_FALSE(snapshot.Contains("new"));
+
+    EXPECT_EQ(map.Size(), 51);
+    EXPECT_FALSE(map.Contains("0"));
+    EXPECT_EQ(map.At("1"), 100);
+
+    map.Clear();
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_EQ(snapshot.Size(), 100);
+}
+
+TEST(PersistentMapTests, ReadersNeverSeePartialWrites)
+{
+    PersistentMap<int, int> map;
+    std::atomic<bool> done { false };
+
+    // every version holds keys [0, n) mapped to n, a reader must never see anything else
+    std::thread reader([&map, &done]() {
+        while (!done) {
+            const auto snapshot = map.Snapshot();
+            const int n = static_cast<int>(snapshot.Size());
+            int count = 0;
+
+            snapshot.ForEach([n, &count](const int& key, const int&) {
+                EXPECT_EQ(key, count);
+                count++;
+            });
+            EXPECT_EQ(count, n);
+        }
+    });
+
+    for (int i = 0; i < 2000; i++)
+        map.Insert(i, i);
+
+    done = true;
+    reader.join();
+}
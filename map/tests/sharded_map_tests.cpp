@@ -0,0 +1,93 @@
+#include "sharded_map.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(ShardedMapTests, EmptyMap)
+{
+    ShardedMap<int, int> map({ 100, 200 });
+
+    EXPECT_EQ(map.ShardCount(), 3);
+    EXPECT_EQ(map.Size(), 0);
+    EXPECT_FALSE(map.Contains(1));
+    EXPECT_THROW(map.At(1), std::out_of_range);
+}
+
+TEST(ShardedMapTests, InvalidBoundaries)
+{
+    EXPECT_THROW((ShardedMap<int, int>({ 5, 5 })), std::invalid_argument);
+    EXPECT_THROW((ShardedMap<int, int>({ 5, 3 })), std::invalid_argument);
+}
+
+TEST(ShardedMapTests, InsertAtRemove)
+{
+    ShardedMap<int, int> map({ 0, 100, 200 });
+
+    for (int i = -50; i < 250; i++)
+        map.Insert(i, i * 2);
+
+    EXPECT_EQ(map.Size(), 300);
+
+    for (int i = -50; i < 250; i++)
+        EXPECT_EQ(map.At(i), i * 2);
+
+    map.Remove(100);
+    map.Remove(-50);
+    map.Remove(1000);
+
+    int value = 0;
+    EXPECT_FALSE(map.TryGet(100, value));
+    EXPECT_TRUE(map.TryGet(99, value));
+    EXPECT_EQ(value, 198);
+    EXPECT_EQ(map.Size(), 298);
+
+    map.Clear();
+    EXPECT_EQ(map.Size(), 0);
+}
+
+TEST(ShardedMapTests, OrderedAcrossShards)
+{
+    ShardedMap<int, int> map({ 10, 20, 30 });
+
+    for (int i = 39; i >= 0; i--)
+        map.Insert(i, i);
+
+    std::vector<int> keys;
+    map.ForEach([&keys](const int& key, const int&) { keys.push_back(key); });
+
+    ASSERT_EQ(keys.size(), 40);
+    for (int i = 0; i < 40; i++)
+        EXPECT_EQ(keys[i], i);
+
+    keys.clear();
+    map.ForEachInRange(5, 30, [&keys](const int& key, const int&) { keys.push_back(key); });
+
+    ASSERT_EQ(keys.size(), 25);
+    EXPECT_EQ(keys.front(), 5);
+    EXPECT_EQ(keys.back(), 29);
+
+    int count = 0;
+    map.ForEachInRange(12, 12, [&count](const int&, const int&) { count++; });
+    EXPECT_EQ(count, 0);
+}
+
+TEST(ShardedMapTests, ConcurrentWriters)
+{
+    ShardedMap<int, int> map({ 1000, 2000, 3000 });
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&map, t]() {
+            for (int i = t; i < 4000; i += 4) {
+                map.Insert(i, i);
+                EXPECT_EQ(map.At(i), i);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(map.Size(), 4000);
+}
@@ -0,0 +1,71 @@
+#include "workloads.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(WorkloadsTests, OrderIsEveryEvenKeyOnce)
+{
+    const std::size_t n = 1000;
+
+    for (const Workload workload :
+         { Workload::SEQUENTIAL, Workload::UNIFORM, Workload::ZIPFIAN, Workload::ADVERSARIAL }) {
+        const KeyStream stream = MakeKeyStream(workload, n, 1);
+
+        std::vector<std::uint64_t> sorted = stream.order;
+        std::sort(sorted.begin(), sorted.end());
+
+        ASSERT_EQ(sorted.size(), n) << WorkloadName(workload);
+        for (std::size_t i = 0; i < n; i++)
+            ASSERT_EQ(sorted[i], 2 * i) << WorkloadName(workload);
+
+        ASSERT_EQ(stream.queries.size(), n);
+        for (const std::uint64_t query : stream.queries) {
+            // only the adversarial lookups miss
+            ASSERT_LT(query, 2 * n);
+            ASSERT_EQ(query % 2, (workload == Workload::ADVERSARIAL) ? 1 : 0);
+        }
+    }
+
+    const KeyStream sequential = MakeKeyStream(Workload::SEQUENTIAL, n, 1);
+    EXPECT_TRUE(std::is_sorted(sequential.order.begin(), sequential.order.end()));
+    EXPECT_EQ(MakeKeyStream(Workload::UNIFORM, n, 7).queries,
+              MakeKeyStream(Workload::UNIFORM, n, 7).queries);
+}
+
+TEST(WorkloadsTests, AdversarialAlternatesEnds)
+{
+    const KeyStream stream = MakeKeyStream(Workload::ADVERSARIAL, 6, 1);
+
+    EXPECT_EQ(stream.order, (std::vector<std::uint64_t> { 0, 10, 2, 8, 4, 6 }));
+}
+
+TEST(WorkloadsTests, ZipfianIsSkewed)
+{
+    const std::size_t n = 10000;
+    ZipfianGenerator zipfian(n);
+    std::mt19937_64 rng(3);
+    std::map<std::uint64_t, std::size_t> counts;
+
+    for (int i = 0; i < 100000; i++) {
+        const std::uint64_t rank = zipfian(rng);
+        ASSERT_LT(rank, n);
+        counts[rank]++;
+    }
+
+    // rank 0 is drawn about 1 / zeta(n) of the time, around a tenth for theta 0.99
+    EXPECT_GT(counts[0], 100000 / 20);
+    EXPECT_GT(counts[0], counts[1]);
+    EXPECT_GT(counts[1], counts[100]);
+}
+
+TEST(WorkloadsTests, Keys)
+{
+    EXPECT_EQ(MakeKey<int>(42), 42);
+    EXPECT_EQ(MakeKey<std::string>(42), "user:0000000000000000042");
+    EXPECT_LT(MakeKey<std::string>(9), MakeKey<std::string>(10));
+    EXPECT_EQ(MakeValue<Payload64>(3).words[7], 3);
+}
@@ -14,99 +14,414 @@
  * limitations under the License.
  */
 
+#include "btree_map.hpp"
+#include "latency_histogram.hpp"
 #include "map.hpp"
+#include "perf_counters.hpp"
+#include "sharded_map.hpp"
+#include <algorithm>
+#include <chrono>
 #include <map>
+#include <mutex>
+#include <numeric>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <random>
+#include <thread>
 #include <time.h>
+#include <type_traits>
+#include <vector>
 
 namespace py = pybind11;
 using MapInt = Map<int, int>;
+using BTreeMapInt = BTreeMap<int, int>;
 using MapIntDouble = Map<int, double>;
+using SumMapIntDouble = AggregateMap<int, double, SumMonoid<double>>;
+using CountingMapInt
+    = Map<int, int, std::allocator<std::pair<const int, int>>, NoAugmentation, ThreadLocalStats<>>;
 using mapInt = std::map<int, int>;
+using ShardedMapInt = ShardedMap<int, int>;
+
+// what ShardedMap replaces: one Map behind one mutex
+class LockedMapInt {
+public:
+    bool TryGet(const int& key, int& out) const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_map.TryGet(key, out);
+    }
+
+    void Insert(const int& key, const int& value)
+    {
+        std::lock_guard lock(m_mutex);
+        m_map.Insert(key, value);
+    }
+
+    std::size_t Size() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_map.Size();
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    MapInt m_map;
+};
+
+// key_range keys split into equal ranges
+ShardedMapInt* MakeShardedMap(const std::size_t shards, const int key_range)
+{
+    std::vector<int> boundaries;
+
+    for (std::size_t i = 1; i < shards; i++)
+        boundaries.push_back(static_cast<int>(key_range * i / shards));
+
+    return new ShardedMapInt(std::move(boundaries));
+}
+
+// set while count_events() runs, the measurements start and stop it together with their clock
+PerfCounters* active_counters = nullptr;
+
+clock_t StartPhase()
+{
+    if (active_counters != nullptr)
+        active_counters->Start();
+
+    return clock();
+}
+
+clock_t StopPhase()
+{
+    const clock_t end = clock();
+
+    if (active_counters != nullptr)
+        active_counters->Stop();
+
+    return end;
+}
+
+// hardware events per operation of the measurements that measure() runs, only those this machine
+// can count; the dict is empty where there are none, e.g. in most containers
+std::map<std::string, double> CountEvents(const py::function& measure, const std::size_t operations)
+{
+    PerfCounters counters;
+    active_counters = &counters;
+
+    try {
+        measure();
+    } catch (...) {
+        active_counters = nullptr;
+        throw;
+    }
+
+    active_counters = nullptr;
+
+    return counters.PerOperation(operations);
+}
+
+std::vector<std::string> PerfEvents()
+{
+    const PerfCounters counters;
+    std::vector<std::string> events;
+
+    for (std::size_t i = 0; i < PerfCounters::kEvents; i++) {
+        if (counters.Available(static_cast<PerfEvent>(i)))
+            events.push_back(PerfCounters::Name(static_cast<PerfEvent>(i)));
+    }
+
+    return events;
+}
+
+// the latency of every insert, lookup and remove of one profiled map
+struct OperationProfile {
+    LatencyHistogram insert;
+    LatencyHistogram lookup;
+    LatencyHistogram remove;
+};
 
 struct ProfileInsertResults {
-    MapIntDouble map_time;
-    MapIntDouble std_map_time;
+    OperationProfile map;
+    OperationProfile std_map;
+    // an empty timed region, the floor under every latency above
+    LatencyHistogram timer;
 };
 
+std::uint64_t ElapsedNanoseconds(const std::chrono::steady_clock::time_point start,
+                                 const std::chrono::steady_clock::time_point end)
+{
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+// inserts, looks up and removes 0 to n - 1 in order, timing each operation on its own
+template <class MapType>
+void ProfileOperations(MapType& map, const int n, OperationProfile& profile)
+{
+    using Clock = std::chrono::steady_clock;
+
+    for (int i = 0; i < n; i++) {
+        const auto start = Clock::now();
+        if constexpr (std::is_same_v<MapType, mapInt>)
+            map.insert({ i, i * 5 });
+        else
+            map.Insert(i, i * 5);
+        profile.insert.Record(ElapsedNanoseconds(start, Clock::now()));
+    }
+
+    // the found values feed a volatile, the lookups cannot be optimized away
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        const auto start = Clock::now();
+        if constexpr (std::is_same_v<MapType, mapInt>)
+            sum += map.find(i)->second;
+        else
+            sum += *map.Find(i);
+        profile.lookup.Record(ElapsedNanoseconds(start, Clock::now()));
+    }
+    volatile int sink = sum;
+    (void)sink;
+
+    for (int i = 0; i < n; i++) {
+        const auto start = Clock::now();
+        if constexpr (std::is_same_v<MapType, mapInt>)
+            map.erase(i);
+        else
+            map.Remove(i);
+        profile.remove.Record(ElapsedNanoseconds(start, Clock::now()));
+    }
+}
+
 ProfileInsertResults ProfileInsert(const std::size_t n)
 {
-    clock_t start, end;
-    double cpu_time_used;
+    using Clock = std::chrono::steady_clock;
+
     MapInt map;
     mapInt std_map;
     ProfileInsertResults result;
 
-    for (std::size_t i = 0; i < n; i++) {
-        start = clock();
-        std_map.insert({ i, i * 5 });
-        end = clock();
-        cpu_time_used = end - start;
-        result.std_map_time.Insert(i, cpu_time_used);
-    }
+    ProfileOperations(std_map, static_cast<int>(n), result.std_map);
+    ProfileOperations(map, static_cast<int>(n), result.map);
 
     for (std::size_t i = 0; i < n; i++) {
-        start = clock();
-        map.Insert(i, i * 5);
-        end = clock();
-        cpu_time_used = end - start;
-        result.map_time.Insert(i, cpu_time_used);
+        const auto start = Clock::now();
+        result.timer.Record(ElapsedNanoseconds(start, Clock::now()));
     }
 
     return result;
 }
 
-double MeasureInsert(MapInt& map, const std::size_t n)
+template <class MapType> double MeasureInsert(MapType& map, const std::size_t n)
 {
     clock_t start, end;
 
-    start = clock();
+    start = StartPhase();
     for (std::size_t i = 0; i < n; i++) {
         map.Insert(i, i * 5);
     }
-    end = clock();
+    end = StopPhase();
 
     return (end - start);
 }
 
-double MeasureAt(MapInt& map)
+template <class MapType> double MeasureAt(MapType& map)
 {
     clock_t start, end;
     int x;
 
-    start = clock();
+    start = StartPhase();
     for (std::size_t i = 0; i < map.Size(); i++) {
         x = map.At(i);
     }
-    end = clock();
+    end = StopPhase();
 
     x++;
 
     return (end - start);
 }
 
-double MeasureRemove(MapInt& map, const std::size_t n)
+double MeasureFind(MapInt& map, const double hit_ratio)
 {
     clock_t start, end;
+    const std::size_t n = map.Size();
+    const std::size_t hit_percent = static_cast<std::size_t>(hit_ratio * 100);
+    std::size_t found = 0;
 
-    start = clock();
+    start = StartPhase();
+    for (std::size_t i = 0; i < n; i++) {
+        // MeasureInsert fills [0, n), everything from n upwards is a miss
+        const std::size_t key = (i % 100) < hit_percent ? i : n + i;
+        found += map.Contains(key);
+    }
+    end = StopPhase();
+
+    found++;
+
+    return (end - start);
+}
+
+double MeasureIterate(MapInt& map)
+{
+    clock_t start, end;
+    long sum = 0;
+
+    start = StartPhase();
+    for (const auto& entry : map) {
+        sum += entry.second;
+    }
+    end = StopPhase();
+
+    sum++;
+
+    return (end - start);
+}
+
+double MeasureCopy(MapInt& map)
+{
+    clock_t start, end;
+
+    start = StartPhase();
+    MapInt copy(map);
+    end = StopPhase();
+
+    return (end - start);
+}
+
+template <class MapType> double MeasureRemove(MapType& map, const std::size_t n)
+{
+    clock_t start, end;
+
+    start = StartPhase();
     for (std::size_t i = 0; i < n; i++) {
         map.Remove(i);
     }
-    end = clock();
+    end = StopPhase();
+
+    return (end - start);
+}
+
+// the same keys as the sequential measurements in a fixed shuffled order, so every run and every
+// container sees identical work
+std::vector<int> ShuffledKeys(const std::size_t n)
+{
+    std::vector<int> keys(n);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(n));
+
+    return keys;
+}
+
+template <class MapType> double MeasureInsertRandom(MapType& map, const std::size_t n)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(n);
+
+    start = StartPhase();
+    for (const int key : keys) {
+        map.Insert(key, key * 5);
+    }
+    end = StopPhase();
+
+    return (end - start);
+}
+
+template <class MapType> double MeasureAtRandom(MapType& map)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(map.Size());
+    int x = 0;
+
+    start = StartPhase();
+    for (const int key : keys) {
+        x += map.At(key);
+    }
+    end = StopPhase();
+
+    x++;
+
+    return (end - start);
+}
+
+template <class MapType> double MeasureRemoveRandom(MapType& map, const std::size_t n)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(n);
+
+    start = StartPhase();
+    for (const int key : keys) {
+        map.Remove(key);
+    }
+    end = StopPhase();
 
     return (end - start);
 }
 
+// the same shuffled keys as MeasureAtRandom, looked up batch_size at a time
+double MeasureLookupBatch(MapInt& map, const std::size_t batch_size)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(map.Size());
+    std::vector<int> values(keys.size());
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+    std::size_t hits = 0;
+
+    start = StartPhase();
+    for (std::size_t i = 0; i < keys.size(); i += batch_size) {
+        const std::size_t count = std::min(batch_size, keys.size() - i);
+        hits += map.LookupBatch(keys.data() + i, count, values.data() + i, found.get() + i);
+    }
+    end = StopPhase();
+
+    hits++;
+
+    return (end - start);
+}
+
+// returns operations per second over all threads. clock() adds up the CPU time of every thread,
+// so this one measures wall time instead
+template <class MapType>
+double MeasureConcurrent(MapType& map, const std::size_t threads, const double read_ratio,
+                         const int key_range, const std::size_t ops_per_thread)
+{
+    for (int key = 0; key < key_range; key++)
+        map.Insert(key, key * 5);
+
+    const std::uint32_t read_percent = static_cast<std::uint32_t>(read_ratio * 100);
+    std::vector<std::thread> workers;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&map, t, read_percent, key_range, ops_per_thread]() {
+            std::mt19937 rng(static_cast<std::uint32_t>(t));
+            int value = 0;
+
+            for (std::size_t i = 0; i < ops_per_thread; i++) {
+                const int key = static_cast<int>(rng() % key_range);
+
+                if (rng() % 100 < read_percent)
+                    map.TryGet(key, value);
+                else
+                    map.Insert(key, value);
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return threads * ops_per_thread / elapsed.count();
+}
+
 double MeasureInsert(mapInt& map, const std::size_t n)
 {
     clock_t start, end;
 
-    start = clock();
+    start = StartPhase();
     for (std::size_t i = 0; i < n; i++) {
         map.insert({ i, i * 5 });
     }
-    end = clock();
+    end = StopPhase();
 
     return (end - start);
 }
@@ -116,26 +431,117 @@ double MeasureAt(mapInt& map)
     clock_t start, end;
     int x;
 
-    start = clock();
+    start = StartPhase();
     for (std::size_t i = 0; i < map.size(); i++) {
         x = map.at(i);
     }
-    end = clock();
+    end = StopPhase();
 
     x++;
 
     return (end - start);
 }
 
+double MeasureFind(mapInt& map, const double hit_ratio)
+{
+    clock_t start, end;
+    const std::size_t n = map.size();
+    const std::size_t hit_percent = static_cast<std::size_t>(hit_ratio * 100);
+    std::size_t found = 0;
+
+    start = StartPhase();
+    for (std::size_t i = 0; i < n; i++) {
+        const std::size_t key = (i % 100) < hit_percent ? i : n + i;
+        found += map.find(key) != map.end();
+    }
+    end = StopPhase();
+
+    found++;
+
+    return (end - start);
+}
+
+double MeasureIterate(mapInt& map)
+{
+    clock_t start, end;
+    long sum = 0;
+
+    start = StartPhase();
+    for (const auto& entry : map) {
+        sum += entry.second;
+    }
+    end = StopPhase();
+
+    sum++;
+
+    return (end - start);
+}
+
+double MeasureCopy(mapInt& map)
+{
+    clock_t start, end;
+
+    start = StartPhase();
+    mapInt copy(map);
+    end = StopPhase();
+
+    return (end - start);
+}
+
 double MeasureRemove(mapInt& map, const std::size_t n)
 {
     clock_t start, end;
 
-    start = clock();
+    start = StartPhase();
     for (std::size_t i = 0; i < n; i++) {
         map.erase(i);
     }
-    end = clock();
+    end = StopPhase();
+
+    return (end - start);
+}
+
+double MeasureInsertRandom(mapInt& map, const std::size_t n)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(n);
+
+    start = StartPhase();
+    for (const int key : keys) {
+        map.insert({ key, key * 5 });
+    }
+    end = StopPhase();
+
+    return (end - start);
+}
+
+double MeasureAtRandom(mapInt& map)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(map.size());
+    int x = 0;
+
+    start = StartPhase();
+    for (const int key : keys) {
+        x += map.at(key);
+    }
+    end = StopPhase();
+
+    x++;
+
+    return (end - start);
+}
+
+double MeasureRemoveRandom(mapInt& map, const std::size_t n)
+{
+    clock_t start, end;
+    const std::vector<int> keys = ShuffledKeys(n);
+
+    start = StartPhase();
+    for (const int key : keys) {
+        map.erase(key);
+    }
+    end = StopPhase();
 
     return (end - start);
 }
@@ -145,33 +551,143 @@ PYBIND11_MODULE(map_module, m)
     py::class_<MapInt>(m, "Map")
         .def(py::init())
         .def("at", &MapInt::At)
-        .def("insert", &MapInt::Insert)
+        .def("contains", &MapInt::Contains)
+        .def("insert", static_cast<void (MapInt::*)(const int&, const int&)>(&MapInt::Insert))
         .def("size", &MapInt::Size)
         .def("save_tree", &MapInt::SaveTree);
 
+    py::class_<BTreeMapInt>(m, "BTreeMap")
+        .def(py::init())
+        .def("at", &BTreeMapInt::At)
+        .def("contains", &BTreeMapInt::Contains)
+        .def("insert", &BTreeMapInt::Insert)
+        .def("remove", &BTreeMapInt::Remove)
+        .def("size", &BTreeMapInt::Size)
+        .def("height", &BTreeMapInt::Height);
+
+    py::class_<ShardedMapInt>(m, "ShardedMap")
+        .def(py::init(&MakeShardedMap))
+        .def("at", &ShardedMapInt::At)
+        .def("contains", &ShardedMapInt::Contains)
+        .def("insert", &ShardedMapInt::Insert)
+        .def("remove", &ShardedMapInt::Remove)
+        .def("size", &ShardedMapInt::Size)
+        .def("shard_count", &ShardedMapInt::ShardCount);
+
+    py::class_<LockedMapInt>(m, "LockedMap")
+        .def(py::init())
+        .def("insert", &LockedMapInt::Insert)
+        .def("size", &LockedMapInt::Size);
+
     py::class_<MapIntDouble>(m, "MapIntDouble")
         .def(py::init())
         .def("at", &MapIntDouble::At)
-        .def("insert", &MapIntDouble::Insert)
+        .def("contains", &MapIntDouble::Contains)
+        .def("insert",
+             static_cast<void (MapIntDouble::*)(const int&, const double&)>(&MapIntDouble::Insert))
         .def("size", &MapIntDouble::Size)
         .def("save_tree", &MapIntDouble::SaveTree);
 
+    py::class_<SumMapIntDouble>(m, "SumMapIntDouble")
+        .def(py::init())
+        .def("at", &SumMapIntDouble::At)
+        .def("contains", &SumMapIntDouble::Contains)
+        .def("insert",
+             static_cast<void (SumMapIntDouble::*)(const int&, const double&)>(
+                 &SumMapIntDouble::Insert))
+        .def("remove", &SumMapIntDouble::Remove)
+        .def("size", &SumMapIntDouble::Size)
+        .def("aggregate", &SumMapIntDouble::Aggregate);
+
+    py::class_<CountingMapInt>(m, "CountingMap")
+        .def(py::init())
+        .def("at", &CountingMapInt::At)
+        .def("contains", &CountingMapInt::Contains)
+        .def("insert",
+             static_cast<void (CountingMapInt::*)(const int&, const int&)>(&CountingMapInt::Insert))
+        .def("remove", &CountingMapInt::Remove)
+        .def("size", &CountingMapInt::Size);
+
+    // the totals of every CountingMap, as a dict of counter name to value
+    m.def("map_stats", []() { return ThreadLocalStats<>::Snapshot().Export(); });
+    m.def("reset_map_stats", &ThreadLocalStats<>::Reset);
+
     py::class_<mapInt>(m, "map").def(py::init());
 
+    py::class_<LatencyHistogram>(m, "LatencyHistogram")
+        .def(py::init())
+        .def("count", &LatencyHistogram::Count)
+        .def("min", &LatencyHistogram::Min)
+        .def("max", &LatencyHistogram::Max)
+        .def("mean", &LatencyHistogram::Mean)
+        .def("percentile", &LatencyHistogram::Percentile)
+        .def("buckets", &LatencyHistogram::Buckets);
+
+    py::class_<OperationProfile>(m, "OperationProfile")
+        .def(py::init())
+        .def_readonly("insert", &OperationProfile::insert)
+        .def_readonly("lookup", &OperationProfile::lookup)
+        .def_readonly("remove", &OperationProfile::remove);
+
     py::class_<ProfileInsertResults>(m, "ProfileInsertResults")
         .def(py::init())
-        .def_readwrite("map_time", &ProfileInsertResults::map_time)
-        .def_readwrite("std_map_time", &ProfileInsertResults::std_map_time);
+        .def_readonly("map", &ProfileInsertResults::map)
+        .def_readonly("std_map", &ProfileInsertResults::std_map)
+        .def_readonly("timer", &ProfileInsertResults::timer);
+
+    m.def("count_events", &CountEvents);
+    m.def("perf_events", &PerfEvents);
 
     m.def("profile_insert",
           static_cast<ProfileInsertResults (*)(const std::size_t)>(&ProfileInsert));
 
     m.def("measure_insert", static_cast<double (*)(MapInt&, const std::size_t)>(&MeasureInsert));
+    m.def("measure_insert",
+          static_cast<double (*)(BTreeMapInt&, const std::size_t)>(&MeasureInsert));
     m.def("measure_insert", static_cast<double (*)(mapInt&, const std::size_t)>(&MeasureInsert));
 
     m.def("measure_at", static_cast<double (*)(MapInt&)>(&MeasureAt));
+    m.def("measure_at", static_cast<double (*)(BTreeMapInt&)>(&MeasureAt));
     m.def("measure_at", static_cast<double (*)(mapInt&)>(&MeasureAt));
 
+    m.def("measure_find", static_cast<double (*)(MapInt&, const double)>(&MeasureFind));
+    m.def("measure_find", static_cast<double (*)(mapInt&, const double)>(&MeasureFind));
+
+    m.def("measure_lookup_batch", &MeasureLookupBatch);
+
+    m.def("measure_iterate", static_cast<double (*)(MapInt&)>(&MeasureIterate));
+    m.def("measure_iterate", static_cast<double (*)(mapInt&)>(&MeasureIterate));
+
+    m.def("measure_copy", static_cast<double (*)(MapInt&)>(&MeasureCopy));
+    m.def("measure_copy", static_cast<double (*)(mapInt&)>(&MeasureCopy));
+
     m.def("measure_remove", static_cast<double (*)(MapInt&, const std::size_t)>(&MeasureRemove));
+    m.def("measure_remove",
+          static_cast<double (*)(BTreeMapInt&, const std::size_t)>(&MeasureRemove));
     m.def("measure_remove", static_cast<double (*)(mapInt&, const std::size_t)>(&MeasureRemove));
+
+    m.def("measure_insert_random",
+          static_cast<double (*)(MapInt&, const std::size_t)>(&MeasureInsertRandom));
+    m.def("measure_insert_random",
+          static_cast<double (*)(BTreeMapInt&, const std::size_t)>(&MeasureInsertRandom));
+    m.def("measure_insert_random",
+          static_cast<double (*)(mapInt&, const std::size_t)>(&MeasureInsertRandom));
+
+    m.def("measure_at_random", static_cast<double (*)(MapInt&)>(&MeasureAtRandom));
+    m.def("measure_at_random", static_cast<double (*)(BTreeMapInt&)>(&MeasureAtRandom));
+    m.def("measure_at_random", static_cast<double (*)(mapInt&)>(&MeasureAtRandom));
+
+    m.def("measure_remove_random",
+          static_cast<double (*)(MapInt&, const std::size_t)>(&MeasureRemoveRandom));
+    m.def("measure_remove_random",
+          static_cast<double (*)(BTreeMapInt&, const std::size_t)>(&MeasureRemoveRandom));
+    m.def("measure_remove_random",
+          static_cast<double (*)(mapInt&, const std::size_t)>(&MeasureRemoveRandom));
+
+    m.def("measure_concurrent",
+          static_cast<double (*)(ShardedMapInt&, const std::size_t, const double, const int,
+                                 const std::size_t)>(&MeasureConcurrent));
+    m.def("measure_concurrent",
+          static_cast<double (*)(LockedMapInt&, const std::size_t, const double, const int,
+                                 const std::size_t)>(&MeasureConcurrent));
 }
@@ -0,0 +1,70 @@
+#!/usr/bin/python3
+
+"""map
+    Copyright 2023 Debby Nirwan
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+"""
+
+
+import json
+import sys
+import pandas as pd
+import plotly.express as px
+
+# plots the JSON map_bench writes with --benchmark_out=<file> --benchmark_out_format=json,
+# one figure per operation, workload and key/value types
+
+filename = sys.argv[1] if len(sys.argv) > 1 else "results.json"
+
+with open(filename) as results_file:
+    results = json.load(results_file)
+
+scale = {"ns": 1e-3, "us": 1.0, "ms": 1e3, "s": 1e6}
+
+operation = []
+workload = []
+types = []
+x = []
+lib_name = []
+time = []
+
+data = {
+    "operation": operation,
+    "workload": workload,
+    "types": types,
+    "number of elements": x,
+    "library name": lib_name,
+    "time (us)": time
+}
+
+for benchmark in results["benchmarks"]:
+    if benchmark.get("run_type") == "aggregate":
+        continue
+
+    # operation/workload/types/library/n/manual_time
+    fields = benchmark["name"].split("/")
+
+    operation.append(fields[0])
+    workload.append(fields[1])
+    types.append(fields[2])
+    lib_name.append(fields[3])
+    x.append(int(fields[4]))
+    time.append(benchmark["real_time"] * scale[benchmark["time_unit"]])
+
+df = pd.DataFrame(data)
+
+for (operation_, workload_, types_), group in df.groupby(["operation", "workload", "types"]):
+    fig = px.line(group, log_x=True, log_y=True, markers=True,
+                  title="%s %s (%s) time performance" % (
+                      operation_.capitalize(), workload_, types_),
+                  x="number of elements", y="time (us)", color="library name")
+    fig.write_image(file="%s_%s_%s_perf.png" %
+                    (operation_, workload_, types_), scale=3.0)
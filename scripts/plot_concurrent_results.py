@@ -0,0 +1,62 @@
+#!/usr/bin/python3
+
+"""map
+    Copyright 2023 Debby Nirwan
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+"""
+
+import map_module
+import pandas as pd
+import plotly.express as px
+
+threads_x = []
+lib_name = []
+read_mix = []
+throughput = []
+
+data = {
+    "threads": threads_x,
+    "library name": lib_name,
+    "reads/writes": read_mix,
+    "throughput (Mops/s)": throughput
+}
+
+key_range = 1000000
+ops_per_thread = 200000
+shards = 32
+
+for read_ratio in [1.0, 0.95, 0.5]:
+    mix = "%d/%d" % (read_ratio * 100, 100 - read_ratio * 100)
+
+    for threads in [1, 2, 4, 8, 16, 32, 64]:
+        locked_map = map_module.LockedMap()
+        sharded_map = map_module.ShardedMap(shards, key_range)
+
+        locked_ops = map_module.measure_concurrent(
+            locked_map, threads, read_ratio, key_range, ops_per_thread)
+        sharded_ops = map_module.measure_concurrent(
+            sharded_map, threads, read_ratio, key_range, ops_per_thread)
+
+        threads_x.append(threads)
+        lib_name.append("Map + mutex")
+        read_mix.append(mix)
+        throughput.append(locked_ops / 1e6)
+
+        threads_x.append(threads)
+        lib_name.append("ShardedMap (%d shards)" % shards)
+        read_mix.append(mix)
+        throughput.append(sharded_ops / 1e6)
+
+data_df = pd.DataFrame(data)
+
+fig = px.line(data_df, log_x=True, markers=True, title="Concurrent throughput",
+              x="threads", y="throughput (Mops/s)", color="library name", facet_col="reads/writes")
+fig.write_image(file="concurrent_perf.png", scale=3.0)
@@ -13,43 +13,46 @@
     limitations under the License.
 """
 
+
 import map_module
-import hash_table_cpp
 import pandas as pd
 import plotly.express as px
 
-element_index = []
-time = []
-lib_name = []
+# latency at each percentile of every insert, lookup and remove of n keys, one figure per
+# operation; the timer line is the cost of reading the clock, included in every latency
 
-data = {
-    "i-th element": element_index,
-    "time (us)": time,
-    "library name": lib_name
-}
+percentiles = [50, 90, 99, 99.9, 99.99, 100]
 
 n = 1000000
 result = map_module.profile_insert(n)
-result_hash_table = hash_table_cpp.profile_insert(n)
-
-for i in range(n):
-    lib_name.append("Map")
-    element_index.append(i)
-    time.append(result.map_time.at(i))
-
-    lib_name.append("std::map")
-    element_index.append(i)
-    time.append(result.std_map_time.at(i))
-
-    lib_name.append("HashTable")
-    element_index.append(i)
-    time.append(result_hash_table.hash_table_time.at(i))
-
-    lib_name.append("std::unordered_map")
-    element_index.append(i)
-    time.append(result_hash_table.unordered_map_time.at(i))
 
-df = pd.DataFrame(data)
-fig = px.line(df, log_x=False, markers=True, title="Insert Profile - Time",
-              x="i-th element", y="time (us)", color="library name")
-fig.write_image(file="insert_profile.png", scale=3.0)
+for operation in ["insert", "lookup", "remove"]:
+    percentile = []
+    time = []
+    lib_name = []
+
+    data = {
+        "percentile": percentile,
+        "time (ns)": time,
+        "library name": lib_name
+    }
+
+    histograms = [("Map", getattr(result.map, operation)),
+                  ("std::map", getattr(result.std_map, operation)),
+                  ("timer", result.timer)]
+
+    for name, histogram in histograms:
+        print("%s %s: p50 %d ns, p99 %d ns, p99.9 %d ns, max %d ns" % (
+            name, operation, histogram.percentile(50), histogram.percentile(99),
+            histogram.percentile(99.9), histogram.max()))
+
+        for p in percentiles:
+            lib_name.append(name)
+            percentile.append("p%g" % p if p < 100 else "max")
+            time.append(histogram.percentile(p))
+
+    df = pd.DataFrame(data)
+    fig = px.line(df, log_y=True, markers=True,
+                  title="%s Profile - Latency" % operation.capitalize(),
+                  x="percentile", y="time (ns)", color="library name")
+    fig.write_image(file="%s_profile.png" % operation, scale=3.0)
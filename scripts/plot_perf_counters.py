@@ -0,0 +1,66 @@
+#!/usr/bin/python3
+
+"""map
+    Copyright 2023 Debby Nirwan
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+"""
+
+
+import map_module
+import pandas as pd
+import plotly.express as px
+
+# hardware events per operation of each measurement, for Map and std::map; only the events
+# perf_event_open() can count on this machine show up, in a container often none
+
+print("perf events available: %s" % ", ".join(map_module.perf_events()))
+
+n = 1000000
+
+phase = []
+lib_name = []
+event = []
+per_operation = []
+
+data = {
+    "phase": phase,
+    "library name": lib_name,
+    "event": event,
+    "per operation": per_operation
+}
+
+for name, make_map in [("Map", map_module.Map), ("std::map", map_module.map)]:
+    container = make_map()
+
+    phases = [
+        ("insert", lambda: map_module.measure_insert(container, n)),
+        ("at", lambda: map_module.measure_at(container)),
+        ("at_random", lambda: map_module.measure_at_random(container)),
+        ("remove", lambda: map_module.measure_remove(container, n))
+    ]
+
+    for phase_name, measure in phases:
+        counts = map_module.count_events(measure, n)
+
+        for event_name, value in counts.items():
+            print("%s %s %s: %.3f" % (name, phase_name, event_name, value))
+
+            phase.append(phase_name)
+            lib_name.append(name)
+            event.append(event_name)
+            per_operation.append(value)
+
+df = pd.DataFrame(data)
+
+for event_name, group in df.groupby("event"):
+    fig = px.bar(group, barmode="group", title="%s per operation" % event_name,
+                 x="phase", y="per operation", color="library name")
+    fig.write_image(file="%s_per_op.png" % event_name, scale=3.0)
@@ -54,6 +54,7 @@ multiplier = 2
 
 while True:
     map = map_module.Map()
+    btree_map = map_module.BTreeMap()
     std_map = map_module.map()
     hash_table = hash_table_cpp.HashTable()
     std_unordered_map = hash_table_cpp.unordered_map()
@@ -62,6 +63,10 @@ while True:
     at_time_ = map_module.measure_at(map)
     remove_time_ = map_module.measure_remove(map, n)
 
+    btree_map_insert_time_ = map_module.measure_insert(btree_map, n)
+    btree_map_at_time_ = map_module.measure_at(btree_map)
+    btree_map_remove_time_ = map_module.measure_remove(btree_map, n)
+
     std_map_insert_time_ = map_module.measure_insert(std_map, n)
     std_map_at_time_ = map_module.measure_at(std_map)
     std_map_remove_time_ = map_module.measure_remove(std_map, n)
@@ -80,6 +85,10 @@ while True:
     insert_lib_name.append("Map")
     insert_time.append(insert_time_)
 
+    insert_x.append(n)
+    insert_lib_name.append("BTreeMap")
+    insert_time.append(btree_map_insert_time_)
+
     insert_x.append(n)
     insert_lib_name.append("std::map")
     insert_time.append(std_map_insert_time_)
@@ -96,6 +105,10 @@ while True:
     at_lib_name.append("Map")
     at_time.append(at_time_)
 
+    at_x.append(n)
+    at_lib_name.append("BTreeMap")
+    at_time.append(btree_map_at_time_)
+
     at_x.append(n)
     at_lib_name.append("std::map")
     at_time.append(std_map_at_time_)
@@ -112,6 +125,10 @@ while True:
     remove_lib_name.append("Map")
     remove_time.append(insert_time_)
 
+    remove_x.append(n)
+    remove_lib_name.append("BTreeMap")
+    remove_time.append(btree_map_remove_time_)
+
     remove_x.append(n)
     remove_lib_name.append("std::map")
     remove_time.append(std_map_remove_time_)